@@ -0,0 +1,170 @@
+// Microbenchmarks for the figure hot paths.
+// Configure with -DCMAKE_BUILD_TYPE=Release before comparing numbers between builds.
+// Machine-readable output: figures_bench --benchmark_format=json --benchmark_out=bench.json
+// Every benchmark takes (collection size, FigureMix) as arguments.
+#include <benchmark/benchmark.h>
+#include "figure_datasets.hpp"
+#include "../include/compact_figures.hpp"
+#include "../include/polygons.hpp"
+
+namespace {
+
+void figureArgs(benchmark::internal::Benchmark* b) {
+    for (int mix = 0; mix < 3; ++mix) {
+        for (int size : {256, 4096, 65536}) {
+            b->Args({size, mix});
+        }
+    }
+    b->ArgNames({"n", "mix"});
+}
+
+struct Dataset {
+    std::vector<Figure*> figures;
+
+    explicit Dataset(const benchmark::State& state)
+        : figures(makeFigures(static_cast<size_t>(state.range(0)),
+                              static_cast<FigureMix>(state.range(1)))) {}
+    ~Dataset() { deleteFigures(figures); }
+};
+
+void setItems(benchmark::State& state, size_t perIteration) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * perIteration));
+    state.SetLabel(figureMixName(static_cast<FigureMix>(state.range(1))));
+}
+
+void BM_Area(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        for (const auto& figure : data.figures) {
+            benchmark::DoNotOptimize(figure->area());
+        }
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_Area)->Apply(figureArgs);
+
+void BM_GeometricCenter(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        for (const auto& figure : data.figures) {
+            benchmark::DoNotOptimize(figure->geometricCenter());
+        }
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_GeometricCenter)->Apply(figureArgs);
+
+void BM_Clone(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        for (const auto& figure : data.figures) {
+            auto copy = figure->clone();
+            benchmark::DoNotOptimize(copy.get());
+        }
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_Clone)->Apply(figureArgs);
+
+void BM_Parse(benchmark::State& state) {
+    Dataset data(state);
+    std::string text = makeFigureText(data.figures);
+    for (auto _ : state) {
+        std::istringstream is(text);
+        for (const auto& figure : data.figures) {
+            is >> *figure;
+        }
+        benchmark::DoNotOptimize(is.good());
+    }
+    setItems(state, data.figures.size());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_Parse)->Apply(figureArgs);
+
+void BM_Print(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        std::ostringstream os;
+        for (const auto& figure : data.figures) {
+            os << *figure;
+        }
+        benchmark::DoNotOptimize(os.tellp());
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_Print)->Apply(figureArgs);
+
+void BM_CalculateTotalArea(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(calculateTotalArea(data.figures));
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_CalculateTotalArea)->Apply(figureArgs);
+
+void BM_RemoveFigureByIndex(benchmark::State& state) {
+    const size_t removals = 64;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto data = std::make_unique<Dataset>(state);
+        state.ResumeTiming();
+        for (size_t i = 0; i < removals; ++i) {
+            removeFigureByIndex(data->figures, data->figures.size() / 2);
+        }
+        state.PauseTiming();
+        data.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * removals));
+    state.SetLabel(figureMixName(static_cast<FigureMix>(state.range(1))));
+}
+BENCHMARK(BM_RemoveFigureByIndex)->Apply(figureArgs);
+
+void BM_CompactTotalArea(benchmark::State& state) {
+    Dataset data(state);
+    CompactFigureStore store(VertexStorage::Float32);
+    store.reserve(data.figures.size());
+    for (const auto& figure : data.figures) {
+        store.add(*figure);
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store.totalArea());
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_CompactTotalArea)->Apply(figureArgs);
+
+void BM_PolygonAreas(benchmark::State& state) {
+    Dataset data(state);
+    PolygonCollection polygons;
+    for (const auto& figure : data.figures) {
+        if (const Triangle* tri = dynamic_cast<const Triangle*>(figure)) {
+            polygons.add(tri->getVertices());
+        } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(figure)) {
+            polygons.add(rect->getVertices());
+        } else if (const Square* square = dynamic_cast<const Square*>(figure)) {
+            polygons.add(square->getVertices());
+        }
+    }
+    std::vector<double> areas(polygons.size());
+    for (auto _ : state) {
+        polygons.areas(areas.data());
+        benchmark::DoNotOptimize(areas.data());
+    }
+    setItems(state, polygons.size());
+}
+BENCHMARK(BM_PolygonAreas)->Apply(figureArgs);
+
+void BM_FindDuplicateFigures(benchmark::State& state) {
+    Dataset data(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(findDuplicateFigures(data.figures));
+    }
+    setItems(state, data.figures.size());
+}
+BENCHMARK(BM_FindDuplicateFigures)->Apply(figureArgs);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+#ifndef FIGURE_DATASETS_HPP
+#define FIGURE_DATASETS_HPP
+
+#include "../include/figures.hpp"
+#include <random>
+#include <sstream>
+#include <string>
+
+enum class FigureMix {
+    Triangles,
+    Quadrilaterals,
+    Mixed
+};
+
+inline const char* figureMixName(FigureMix mix) {
+    switch (mix) {
+        case FigureMix::Triangles: return "triangles";
+        case FigureMix::Quadrilaterals: return "quads";
+        default: return "mixed";
+    }
+}
+
+// Axis-aligned figures with random position and size, reproducible per seed.
+// Quadrilaterals alternate between squares and rectangles.
+inline std::vector<Figure*> makeFigures(size_t count, FigureMix mix, unsigned seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coord(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> side(1.0, 50.0);
+    std::vector<Figure*> figures;
+    figures.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        double x = coord(rng), y = coord(rng), w = side(rng), h = side(rng);
+        int kind = mix == FigureMix::Triangles ? 0
+                 : mix == FigureMix::Quadrilaterals ? 1 + static_cast<int>(i % 2)
+                 : static_cast<int>(i % 3);
+        switch (kind) {
+            case 0:
+                figures.push_back(new Triangle({{{x, y}, {x + w, y}, {x, y + h}}}));
+                break;
+            case 1:
+                figures.push_back(new Square({{{x, y}, {x + w, y}, {x + w, y + w}, {x, y + w}}}));
+                break;
+            default:
+                figures.push_back(new Rectangle({{{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}}}));
+        }
+    }
+    return figures;
+}
+
+// Vertex text for the figures, in the order operator>> expects.
+inline std::string makeFigureText(const std::vector<Figure*>& figures) {
+    std::ostringstream os;
+    os.precision(17);
+    for (const auto& figure : figures) {
+        auto write = [&os](const auto& vertices) {
+            for (const auto& vertex : vertices) {
+                os << vertex.first << ' ' << vertex.second << ' ';
+            }
+        };
+        if (const Triangle* tri = dynamic_cast<const Triangle*>(figure)) {
+            write(tri->getVertices());
+        } else if (const Square* square = dynamic_cast<const Square*>(figure)) {
+            write(square->getVertices());
+        } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(figure)) {
+            write(rect->getVertices());
+        }
+        os << '\n';
+    }
+    return os.str();
+}
+
+inline void deleteFigures(std::vector<Figure*>& figures) {
+    for (auto figure : figures) {
+        delete figure;
+    }
+    figures.clear();
+}
+
+#endif
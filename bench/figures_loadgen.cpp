@@ -0,0 +1,115 @@
+// Load generator for figures_main --serve.
+// Usage: figures_loadgen <socket> [connections=4] [requests per connection=10000] [pipeline depth=32]
+// Each connection sends windows of pipelined requests (60% ADD, 20% TOTAL,
+// 10% COUNT, 10% REMOVE of its own earlier figures) and waits for every
+// response before sending the next window.
+#include "../include/figure_server.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+struct WorkerResult {
+    size_t requests = 0;
+    size_t errors = 0;
+    std::vector<double> windowMicros;
+};
+
+void runWorker(const std::string& socketPath, size_t requestCount, size_t pipeline,
+               unsigned seed, WorkerResult& result) {
+    FigureClient client(socketPath);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coord(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> side(1.0, 50.0);
+    std::vector<std::uint64_t> ownIds;
+    std::vector<bool> isAdd;
+
+    while (result.requests < requestCount) {
+        size_t window = std::min(pipeline, requestCount - result.requests);
+        isAdd.assign(window, false);
+        for (size_t i = 0; i < window; ++i) {
+            size_t slot = (result.requests + i) % 10;
+            if (slot < 6) {
+                double x = coord(rng), y = coord(rng), w = side(rng), h = side(rng);
+                std::ostringstream os;
+                os << "ADD RECTANGLE " << x << ' ' << y << ' ' << x + w << ' ' << y << ' '
+                   << x + w << ' ' << y + h << ' ' << x << ' ' << y + h;
+                client.send(os.str());
+                isAdd[i] = true;
+            } else if (slot < 8) {
+                client.send("TOTAL");
+            } else if (slot == 8 || ownIds.empty()) {
+                client.send("COUNT");
+            } else {
+                client.send("REMOVE " + std::to_string(ownIds.back()));
+                ownIds.pop_back();
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        client.flush();
+        for (size_t i = 0; i < window; ++i) {
+            std::string line = client.readLine();
+            if (line.compare(0, 2, "OK") != 0) {
+                ++result.errors;
+            } else if (isAdd[i]) {
+                ownIds.push_back(std::stoull(line.substr(3)));
+            }
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        result.windowMicros.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        result.requests += window;
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <socket> [connections] [requests per connection] [pipeline depth]\n";
+        return 1;
+    }
+    std::string socketPath = argv[1];
+    size_t connections = argc > 2 ? std::stoul(argv[2]) : 4;
+    size_t requestCount = argc > 3 ? std::stoul(argv[3]) : 10000;
+    size_t pipeline = std::max<size_t>(1, argc > 4 ? std::stoul(argv[4]) : 32);
+
+    std::vector<WorkerResult> results(connections);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < connections; ++c) {
+        workers.emplace_back([&, c]() {
+            try {
+                runWorker(socketPath, requestCount, pipeline, static_cast<unsigned>(c + 1), results[c]);
+            } catch (const std::exception& e) {
+                std::cerr << "Connection " << c << ": " << e.what() << "\n";
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t requests = 0, errors = 0;
+    std::vector<double> windows;
+    for (const auto& result : results) {
+        requests += result.requests;
+        errors += result.errors;
+        windows.insert(windows.end(), result.windowMicros.begin(), result.windowMicros.end());
+    }
+    std::sort(windows.begin(), windows.end());
+    auto percentile = [&windows](double q) {
+        return windows.empty() ? 0.0 : windows[static_cast<size_t>(q * (windows.size() - 1))];
+    };
+
+    std::cout << "connections=" << connections << " pipeline=" << pipeline
+              << " requests=" << requests << " errors=" << errors
+              << " seconds=" << seconds
+              << " requests_per_second=" << (seconds > 0 ? requests / seconds : 0)
+              << " window_p50_us=" << percentile(0.5)
+              << " window_p99_us=" << percentile(0.99) << "\n";
+    return errors == 0 && requests == connections * requestCount ? 0 : 1;
+}
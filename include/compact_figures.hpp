@@ -0,0 +1,69 @@
+#ifndef COMPACT_FIGURES_HPP
+#define COMPACT_FIGURES_HPP
+
+#include "figures.hpp"
+#include <cstdint>
+
+enum class FigureType : std::uint8_t {
+    Triangle,
+    Square,
+    Rectangle
+};
+
+enum class VertexStorage {
+    Float32,
+    Fixed32
+};
+
+// Flat store of figures with 32-bit coordinates. Every figure takes four
+// vertex slots (triangles leave the last one unused) plus a one-byte type tag,
+// so a rectangle costs 33 bytes instead of a heap-allocated Rectangle.
+//
+// Float32 rounds each coordinate c to the nearest float: error <= |c| * 2^-24,
+// and |c| must not exceed FLT_MAX.
+// Fixed32 stores round((c - origin) / scale) as int32: error <= scale / 2, and
+// coordinates must lie within origin +- scale * 2^31.
+// Area and centroid are computed in double from the decoded vertices, so with
+// a per-coordinate error e the centroid is off by at most e per axis and the
+// area by at most sqrt(2) * e * perimeter (to first order).
+class CompactFigureStore {
+private:
+    VertexStorage mode;
+    std::pair<double, double> origin;
+    double scale;
+    std::vector<FigureType> types;
+    std::vector<float> floatCoords;
+    std::vector<std::int32_t> fixedCoords;
+
+    float encodeFloat(double value) const;
+    std::int32_t encodeFixed(double value, double base) const;
+
+public:
+    explicit CompactFigureStore(VertexStorage mode = VertexStorage::Float32,
+                                std::pair<double, double> origin = {0.0, 0.0},
+                                double scale = 1.0 / 1024);
+
+    // Fixed32 store whose origin and scale cover the bounding box of figures.
+    static CompactFigureStore fitFixed32(const std::vector<Figure*>& figures);
+
+    // Throws std::out_of_range, adding nothing, if a coordinate does not fit the mode.
+    void add(const Figure& figure);
+    void reserve(size_t count);
+    size_t size() const { return types.size(); }
+    VertexStorage storage() const { return mode; }
+
+    FigureType type(size_t index) const { return types[index]; }
+    size_t vertexCount(size_t index) const { return types[index] == FigureType::Triangle ? 3 : 4; }
+    std::pair<double, double> vertex(size_t index, size_t k) const;
+
+    double area(size_t index) const;
+    std::pair<double, double> geometricCenter(size_t index) const;
+    std::unique_ptr<Figure> figure(size_t index) const;
+
+    double totalArea() const;
+    // Worst-case per-coordinate error for a coordinate of the given magnitude.
+    double coordinateErrorBound(double magnitude) const;
+    size_t memoryBytes() const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CONCURRENT_FIGURES_HPP
+#define CONCURRENT_FIGURES_HPP
+
+#include "figures.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Immutable view of a ConcurrentFigureCollection. Figures are grouped in
+// fixed-size chunks shared between consecutive snapshots, so a write only
+// copies the chunk it touches plus the chunk pointer list.
+class FigureSnapshot {
+public:
+    struct Chunk {
+        std::vector<std::shared_ptr<const Figure>> figures;
+        std::vector<std::uint64_t> ids;
+        double area = 0;
+    };
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    double totalArea() const { return area; }
+    // Removal drops emptied chunks and merges ones below a quarter full into
+    // a neighbour with room, so this stays O(size() / kChunkSize) whatever
+    // the removal order (kChunkSize is ConcurrentFigureCollection's).
+    size_t chunkCount() const { return chunks.size(); }
+
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& chunk : chunks) {
+            for (size_t i = 0; i < chunk->figures.size(); ++i) {
+                fn(chunk->ids[i], *chunk->figures[i]);
+            }
+        }
+    }
+
+private:
+    friend class ConcurrentFigureCollection;
+
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    size_t count = 0;
+    double area = 0;
+};
+
+// Figure collection for concurrent producers and readers. Readers never take
+// a lock: read() enters an RCU read-side section (two counter updates on a
+// per-thread slot) and runs on the snapshot current at that moment. Writers
+// serialize among themselves, publish a new snapshot and free the old one
+// only after every reader that could still see it has left.
+class ConcurrentFigureCollection {
+public:
+    static const size_t kChunkSize = 256;
+
+    ConcurrentFigureCollection();
+    ~ConcurrentFigureCollection();
+
+    ConcurrentFigureCollection(const ConcurrentFigureCollection&) = delete;
+    ConcurrentFigureCollection& operator=(const ConcurrentFigureCollection&) = delete;
+
+    std::uint64_t insert(std::unique_ptr<Figure> figure);
+    // Inserts the whole batch under one snapshot publication.
+    std::vector<std::uint64_t> insert(std::vector<std::unique_ptr<Figure>> figures);
+    bool remove(std::uint64_t id);
+
+    template <typename Fn>
+    auto read(Fn fn) const -> decltype(fn(std::declval<const FigureSnapshot&>())) {
+        ReadSection section(*this);
+        return fn(*current.load());
+    }
+
+    size_t size() const;
+    double totalArea() const;
+
+private:
+    static const size_t kReaderSlots = 64;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<long> active[2];
+    };
+
+    class ReadSection {
+    public:
+        explicit ReadSection(const ConcurrentFigureCollection& collection);
+        ~ReadSection();
+        ReadSection(const ReadSection&) = delete;
+        ReadSection& operator=(const ReadSection&) = delete;
+
+    private:
+        std::atomic<long>& counter;
+    };
+
+    mutable std::array<ReaderSlot, kReaderSlots> readers;
+    std::atomic<unsigned> epoch;
+    std::atomic<const FigureSnapshot*> current;
+
+    std::mutex writeMutex;
+    std::unordered_map<std::uint64_t, size_t> chunkOfId;
+    std::uint64_t nextId;
+
+    void publish(const FigureSnapshot* next);
+    void waitForReaders(unsigned parity);
+};
+
+void printAllFiguresInfo(const FigureSnapshot& snapshot);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef FIGURE_SERVER_HPP
+#define FIGURE_SERVER_HPP
+
+#include "concurrent_figures.hpp"
+#include <string>
+
+// Line protocol, one request per line, answered in order per connection:
+//   ADD TRIANGLE x1 y1 x2 y2 x3 y3        -> OK <id>
+//   ADD SQUARE|RECTANGLE x1 y1 ... x4 y4  -> OK <id>
+//   REMOVE <id>                           -> OK | ERR not found
+//   TOTAL                                 -> OK <total area>
+//   COUNT                                 -> OK <figure count>
+//   REPORT                                -> FIGURE <id> <area> <cx> <cy> per figure, then OK <count>
+// Malformed requests get a single "ERR <reason>" line.
+//
+// Clients may pipeline any number of requests. Each epoll round collects the
+// complete lines from every ready connection and runs them as one batch:
+// consecutive ADDs become a single collection insert and consecutive reads
+// share one snapshot, while the global request order is preserved. A round
+// takes a bounded number of lines per connection, and a connection whose
+// responses are not being read stops being read from until they drain.
+// When accept() runs out of descriptors (EMFILE/ENFILE) the listen socket is
+// unwatched until a connection closes or a short retry interval passes.
+//
+// The constructor replaces a leftover socket file at the path, but fails if
+// the path is another kind of file or a live server is listening on it.
+class FigureServer {
+public:
+    explicit FigureServer(const std::string& socketPath);
+    ~FigureServer();
+
+    FigureServer(const FigureServer&) = delete;
+    FigureServer& operator=(const FigureServer&) = delete;
+
+    // Serves until stop() is called. Not reentrant.
+    void run();
+    // Safe to call from another thread or a signal handler.
+    void stop();
+
+    ConcurrentFigureCollection& collection() { return figures; }
+
+private:
+    struct Connection;
+    struct Request;
+
+    std::string path;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    ConcurrentFigureCollection figures;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Connection>> connections;
+    std::uint64_t nextConnectionId;
+    // Connections with complete lines left over for the next round.
+    std::vector<std::uint64_t> backlog;
+    bool acceptPaused;
+
+    void acceptConnections();
+    void readRequests(std::uint64_t id, Connection& connection, std::vector<Request>& requests);
+    void executeBatch(const std::vector<Request>& requests);
+    void flushConnection(std::uint64_t id, Connection& connection);
+    void closeConnection(std::uint64_t id);
+    void watchListener(bool watch);
+};
+
+// Blocking client for the protocol above, used by figures_loadgen and tests.
+class FigureClient {
+public:
+    explicit FigureClient(const std::string& socketPath);
+    ~FigureClient();
+
+    FigureClient(const FigureClient&) = delete;
+    FigureClient& operator=(const FigureClient&) = delete;
+
+    // Queues one request line; nothing is sent until flush().
+    void send(const std::string& line);
+    void flush();
+    // Flushes, then half-closes: the server answers what was sent and closes.
+    void finish();
+    std::string readLine();
+
+private:
+    int fd;
+    std::string outgoing;
+    std::string incoming;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include <memory>
 #include <stdexcept>
 #include <vector>
+#include <cstddef>
 
 class Figure {
 public:
@@ -104,6 +105,62 @@ public:
     const std::array<std::pair<double, double>, 4>& getVertices() const { return vertices; }
 };
 
+enum class QuadrilateralKind {
+    Square,
+    Rectangle,
+    General,
+    Degenerate,
+    SelfIntersecting
+};
+
+const double kDefaultShapeTolerance = 1e-9;
+
+// Tolerance is relative to the longest side, so it works for any scale.
+QuadrilateralKind classifyQuadrilateral(const std::array<std::pair<double, double>, 4>& vertices,
+                                        double tolerance = kDefaultShapeTolerance);
+
+// Bulk kernel over vertex-major input: xs[k * count + i], ys[k * count + i] is
+// vertex k of quad i, so each vertex is a contiguous array across quads.
+void classifyQuadrilaterals(const double* xs, const double* ys, size_t count,
+                            QuadrilateralKind* kinds, double tolerance = kDefaultShapeTolerance);
+
+struct ValidationReport {
+    std::vector<size_t> invalidIndices;
+    std::vector<QuadrilateralKind> invalidKinds;
+};
+
+// Checks every Square and Rectangle in the collection against its declared shape.
+ValidationReport validateFigures(const std::vector<Figure*>& figures,
+                                 double tolerance = kDefaultShapeTolerance);
+
+// Text input is usually rounded to the default six significant digits, which
+// moves a right angle by up to ~1e-5 relative to the side for figures near the
+// origin, so reads are checked much more loosely than kDefaultShapeTolerance.
+const double kDefaultReadTolerance = 1e-4;
+
+// When enabled, Square/Rectangle::readVertices set failbit and keep the old
+// vertices if the points read do not form the declared shape within tolerance.
+void setRejectInvalidOnRead(bool enabled, double tolerance = kDefaultReadTolerance);
+bool rejectInvalidOnRead();
+double rejectInvalidTolerance();
+
+// Hash of the figure type and its vertex cycle, independent of the starting
+// vertex and of the traversal direction. With quantum > 0 coordinates are
+// snapped to a grid of that step first, so near-equal figures collide.
+// Figure subclasses other than Triangle, Square and Rectangle only match
+// the same object.
+size_t figureHash(const Figure& figure, double quantum = 0.0);
+bool sameFigure(const Figure& a, const Figure& b, double quantum = 0.0);
+
+// Indices (ascending) of figures that repeat an earlier one under sameFigure.
+// threadCount == 0 uses std::thread::hardware_concurrency(); small
+// collections are scanned on the calling thread.
+std::vector<size_t> findDuplicateFigures(const std::vector<Figure*>& figures,
+                                         double quantum = 0.0, unsigned threadCount = 0);
+// Deletes the duplicates found by findDuplicateFigures, keeping first occurrences.
+size_t removeDuplicateFigures(std::vector<Figure*>& figures, double quantum = 0.0,
+                              unsigned threadCount = 0);
+
 std::ostream& operator<<(std::ostream& os, const Figure& figure);
 std::istream& operator>>(std::istream& is, Figure& figure);
 
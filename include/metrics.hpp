@@ -0,0 +1,75 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+enum class Metric {
+    Area,
+    GeometricCenter,
+    Parse,
+    Print,
+    Insert,
+    Remove,
+    TotalArea
+};
+
+const size_t kMetricCount = 7;
+// Bucket b counts latencies in [2^b, 2^(b+1)) ns; the last bucket is open-ended.
+const size_t kHistogramBuckets = 32;
+
+struct MetricSummary {
+    std::uint64_t count = 0;
+    std::uint64_t totalNs = 0;
+    std::uint64_t maxNs = 0;
+    std::array<std::uint64_t, kHistogramBuckets> buckets{};
+
+    // Upper bound of the histogram bucket holding the given quantile.
+    std::uint64_t quantileNs(double quantile) const;
+};
+
+const char* metricName(Metric metric);
+
+// Counters are kept per thread and only summed on collection, so recording
+// never contends with other threads.
+void recordMetric(Metric metric, std::uint64_t nanoseconds);
+std::array<MetricSummary, kMetricCount> collectMetrics();
+// Not synchronized with threads that are recording at the same moment.
+void resetMetrics();
+
+void dumpMetricsText(std::ostream& os);
+void dumpMetricsJson(std::ostream& os);
+
+#ifdef FIGURES_ENABLE_METRICS
+
+const bool kMetricsEnabled = true;
+
+class ScopedMetric {
+private:
+    Metric metric;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedMetric(Metric metric) : metric(metric), start(std::chrono::steady_clock::now()) {}
+    ~ScopedMetric() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        recordMetric(metric, static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    ScopedMetric(const ScopedMetric&) = delete;
+    ScopedMetric& operator=(const ScopedMetric&) = delete;
+};
+
+#define FIGURES_METRIC(name) ScopedMetric figuresScopedMetric(Metric::name)
+
+#else
+
+const bool kMetricsEnabled = false;
+
+#define FIGURES_METRIC(name) do {} while (0)
+
+#endif
+
+#endif
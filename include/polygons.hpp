@@ -0,0 +1,58 @@
+#ifndef POLYGONS_HPP
+#define POLYGONS_HPP
+
+#include "figures.hpp"
+
+// Simple polygons with any number of vertices, stored as compressed sparse
+// rows: polygon i owns coordinates [offsets[i], offsets[i + 1]) of xs/ys.
+// No per-polygon heap object is created.
+class PolygonCollection {
+private:
+    std::vector<double> xs;
+    std::vector<double> ys;
+    std::vector<size_t> offsets;
+
+public:
+    // Upper bound on the vertex count accepted by readPolygon.
+    static const size_t kMaxVertices = size_t(1) << 20;
+
+    PolygonCollection();
+
+    // Throws std::invalid_argument for fewer than 3 vertices.
+    void add(const std::pair<double, double>* vertices, size_t count);
+    void add(const std::vector<std::pair<double, double>>& vertices) {
+        add(vertices.data(), vertices.size());
+    }
+    template <size_t N>
+    void add(const std::array<std::pair<double, double>, N>& vertices) {
+        add(vertices.data(), N);
+    }
+    void remove(size_t index);
+    void reserve(size_t polygons, size_t vertices);
+    void clear();
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+    size_t vertexCount(size_t index) const { return offsets[index + 1] - offsets[index]; }
+    size_t totalVertices() const { return xs.size(); }
+    std::pair<double, double> vertex(size_t index, size_t k) const;
+
+    // Shoelace formula, same as Rectangle::area generalized to n vertices.
+    double area(size_t index) const;
+    // Area centroid; falls back to the vertex mean for zero-area polygons.
+    std::pair<double, double> geometricCenter(size_t index) const;
+    // Bulk kernels: write the area / centroid of every polygon into out[0..size()).
+    void areas(double* out) const;
+    void centroids(std::pair<double, double>* out) const;
+    double totalArea() const;
+
+    void printVertices(std::ostream& os, size_t index) const;
+    // Reads a vertex count followed by that many "x y" pairs. Sets failbit and
+    // adds nothing if the count is outside [3, kMaxVertices] or a pair is missing.
+    void readPolygon(std::istream& is);
+};
+
+double calculateTotalArea(const std::vector<Figure*>& figures, const PolygonCollection& polygons);
+void printAllFiguresInfo(const std::vector<Figure*>& figures, const PolygonCollection& polygons);
+
+#endif
@@ -1,12 +1,105 @@
 
 #include "include/figures.hpp"
+#include "include/metrics.hpp"
+#ifdef FIGURES_WITH_SERVER
+#include "include/figure_server.hpp"
+#include <atomic>
+#include <csignal>
+#endif
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <vector>
+#include <string>
 
-int main() {
+#ifdef FIGURES_WITH_SERVER
+// Lock-free, so loading it from the signal handler is async-signal-safe.
+static std::atomic<FigureServer*> activeServer{nullptr};
+static_assert(std::atomic<FigureServer*>::is_always_lock_free,
+              "the signal handler needs a lock-free pointer");
+
+extern "C" void stopActiveServer(int) {
+    if (FigureServer* server = activeServer.load()) {
+        server->stop();
+    }
+}
+
+// Clears activeServer before the server it points to is destroyed, also
+// when run() throws.
+struct ActiveServerGuard {
+    explicit ActiveServerGuard(FigureServer& server) { activeServer.store(&server); }
+    ~ActiveServerGuard() { activeServer.store(nullptr); }
+};
+
+static int serve(const std::string& socketPath) {
+    try {
+        FigureServer server(socketPath);
+        ActiveServerGuard guard(server);
+        std::signal(SIGINT, stopActiveServer);
+        std::signal(SIGTERM, stopActiveServer);
+        std::cout << "Serving figures on " << socketPath << "\n";
+        server.run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+// Reads four "x y" pairs from std::cin into the figure. Malformed input is
+// reported as such and the rest of the line is dropped; only numbers that
+// parsed but fail the --strict shape check count as a rejected shape.
+static bool readQuadrilateral(Figure& figure, const char* shape) {
+    std::ostringstream numbers;
+    numbers.precision(std::numeric_limits<double>::max_digits10);
+    for (int i = 0; i < 8; ++i) {
+        double value;
+        if (!(std::cin >> value)) {
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            std::cout << "Invalid input, expected 8 numbers.\n";
+            return false;
+        }
+        numbers << value << ' ';
+    }
+    std::istringstream is(numbers.str());
+    if (!(is >> figure)) {
+        std::cout << "Points do not form a " << shape << ", rejected.\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
     std::vector<Figure*> figures;
     int choice;
     
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--strict") {
+            setRejectInvalidOnRead(true);
+        } else if (arg.compare(0, 9, "--strict=") == 0) {
+            char* end = nullptr;
+            double tolerance = std::strtod(arg.c_str() + 9, &end);
+            if (end == arg.c_str() + 9 || *end != '\0' || !(tolerance >= 0)) {
+                std::cerr << "Usage: " << argv[0] << " --strict[=<tolerance>]\n";
+                return 1;
+            }
+            setRejectInvalidOnRead(true, tolerance);
+        }
+#ifdef FIGURES_WITH_SERVER
+        else if (arg == "--serve") {
+            if (i + 1 == argc) {
+                std::cerr << "Usage: " << argv[0] << " --serve <socket path>\n";
+                return 1;
+            }
+            return serve(argv[i + 1]);
+        }
+#endif
+    }
+    
     do {
         std::cout << "1. Add Triangle\n";
         std::cout << "2. Add Square\n";
@@ -15,7 +108,16 @@ int main() {
         std::cout << "5. Calculate total area\n";
         std::cout << "6. Remove figure by index\n";
         std::cout << "7. Exit\n";
-        std::cin >> choice;
+        std::cout << "8. Dump metrics\n";
+        if (!(std::cin >> choice)) {
+            if (std::cin.eof()) {
+                choice = 7;
+            } else {
+                std::cin.clear();
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                choice = 0;
+            }
+        }
         
         switch (choice) {
             case 1: {
@@ -29,7 +131,10 @@ int main() {
             case 2: {
                 Square* square = new Square();
                 std::cout << "Enter 4 vertices for square (x y):\n";
-                std::cin >> *square;
+                if (!readQuadrilateral(*square, "square")) {
+                    delete square;
+                    break;
+                }
                 figures.push_back(square);
                 std::cout << "Square added!\n";
                 break;
@@ -37,7 +142,10 @@ int main() {
             case 3: {
                 Rectangle* rectangle = new Rectangle();
                 std::cout << "Enter 4 vertices for rectangle (x y):\n";
-                std::cin >> *rectangle;
+                if (!readQuadrilateral(*rectangle, "rectangle")) {
+                    delete rectangle;
+                    break;
+                }
                 figures.push_back(rectangle);
                 std::cout << "Rectangle added\n";
                 break;
@@ -72,6 +180,17 @@ int main() {
             case 7:
                 std::cout << "Exiting program.\n";
                 break;
+            case 8: {
+                std::string format;
+                std::cout << "Enter format (text/json): ";
+                std::cin >> format;
+                if (format == "json") {
+                    dumpMetricsJson(std::cout);
+                } else {
+                    dumpMetricsText(std::cout);
+                }
+                break;
+            }
             default:
                 std::cout << "Invalid option. Please try again.\n";
         }
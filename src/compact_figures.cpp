@@ -0,0 +1,188 @@
+#include "../include/compact_figures.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const size_t kSlots = 4;
+
+template <size_t N>
+void appendVertices(const std::array<std::pair<double, double>, N>& vertices,
+                    std::array<std::pair<double, double>, kSlots>& slots) {
+    for (size_t i = 0; i < N; ++i) {
+        slots[i] = vertices[i];
+    }
+}
+
+template <size_t N>
+std::array<std::pair<double, double>, N> decode(const CompactFigureStore& store, size_t index) {
+    std::array<std::pair<double, double>, N> vertices;
+    for (size_t i = 0; i < N; ++i) {
+        vertices[i] = store.vertex(index, i);
+    }
+    return vertices;
+}
+
+}
+
+CompactFigureStore::CompactFigureStore(VertexStorage mode, std::pair<double, double> origin,
+                                       double scale)
+    : mode(mode), origin(origin), scale(scale) {
+    if (!(scale > 0)) {
+        throw std::invalid_argument("CompactFigureStore scale must be positive");
+    }
+}
+
+CompactFigureStore CompactFigureStore::fitFixed32(const std::vector<Figure*>& figures) {
+    double minX = std::numeric_limits<double>::max(), minY = minX;
+    double maxX = std::numeric_limits<double>::lowest(), maxY = maxX;
+    auto extend = [&](const auto& vertices) {
+        for (const auto& vertex : vertices) {
+            minX = std::min(minX, vertex.first);
+            maxX = std::max(maxX, vertex.first);
+            minY = std::min(minY, vertex.second);
+            maxY = std::max(maxY, vertex.second);
+        }
+    };
+    for (const auto& figure : figures) {
+        if (const Triangle* tri = dynamic_cast<const Triangle*>(figure)) {
+            extend(tri->getVertices());
+        } else if (const Square* square = dynamic_cast<const Square*>(figure)) {
+            extend(square->getVertices());
+        } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(figure)) {
+            extend(rect->getVertices());
+        }
+    }
+    if (minX > maxX) {
+        return CompactFigureStore(VertexStorage::Fixed32);
+    }
+
+    double halfExtent = std::max(maxX - minX, maxY - minY) / 2.0;
+    // One bit of headroom keeps rounding at the box edges inside int32.
+    double scale = halfExtent > 0 ? halfExtent / 1073741824.0 : 1.0 / 1024;
+    return CompactFigureStore(VertexStorage::Fixed32,
+                              {(minX + maxX) / 2.0, (minY + maxY) / 2.0}, scale);
+}
+
+std::int32_t CompactFigureStore::encodeFixed(double value, double base) const {
+    double steps = std::round((value - base) / scale);
+    if (!(steps >= std::numeric_limits<std::int32_t>::min() &&
+          steps <= std::numeric_limits<std::int32_t>::max())) {
+        throw std::out_of_range("Coordinate outside fixed-point range");
+    }
+    return static_cast<std::int32_t>(steps);
+}
+
+float CompactFigureStore::encodeFloat(double value) const {
+    if (!(std::abs(value) <= std::numeric_limits<float>::max())) {
+        throw std::out_of_range("Coordinate outside float range");
+    }
+    return static_cast<float>(value);
+}
+
+void CompactFigureStore::add(const Figure& figure) {
+    std::array<std::pair<double, double>, kSlots> slots{};
+    FigureType figureType;
+    if (const Triangle* tri = dynamic_cast<const Triangle*>(&figure)) {
+        figureType = FigureType::Triangle;
+        appendVertices(tri->getVertices(), slots);
+        slots[3] = slots[2];
+    } else if (const Square* square = dynamic_cast<const Square*>(&figure)) {
+        figureType = FigureType::Square;
+        appendVertices(square->getVertices(), slots);
+    } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(&figure)) {
+        figureType = FigureType::Rectangle;
+        appendVertices(rect->getVertices(), slots);
+    } else {
+        throw std::invalid_argument("Unsupported figure type");
+    }
+
+    if (mode == VertexStorage::Float32) {
+        std::array<float, 2 * kSlots> encoded;
+        for (size_t i = 0; i < kSlots; ++i) {
+            encoded[2 * i] = encodeFloat(slots[i].first);
+            encoded[2 * i + 1] = encodeFloat(slots[i].second);
+        }
+        floatCoords.insert(floatCoords.end(), encoded.begin(), encoded.end());
+    } else {
+        std::array<std::int32_t, 2 * kSlots> encoded;
+        for (size_t i = 0; i < kSlots; ++i) {
+            encoded[2 * i] = encodeFixed(slots[i].first, origin.first);
+            encoded[2 * i + 1] = encodeFixed(slots[i].second, origin.second);
+        }
+        fixedCoords.insert(fixedCoords.end(), encoded.begin(), encoded.end());
+    }
+    types.push_back(figureType);
+}
+
+void CompactFigureStore::reserve(size_t count) {
+    types.reserve(count);
+    if (mode == VertexStorage::Float32) {
+        floatCoords.reserve(2 * kSlots * count);
+    } else {
+        fixedCoords.reserve(2 * kSlots * count);
+    }
+}
+
+std::pair<double, double> CompactFigureStore::vertex(size_t index, size_t k) const {
+    size_t offset = 2 * (kSlots * index + k);
+    if (mode == VertexStorage::Float32) {
+        return {floatCoords[offset], floatCoords[offset + 1]};
+    }
+    return {origin.first + fixedCoords[offset] * scale,
+            origin.second + fixedCoords[offset + 1] * scale};
+}
+
+double CompactFigureStore::area(size_t index) const {
+    switch (types[index]) {
+        case FigureType::Triangle:
+            return Triangle(decode<3>(*this, index)).area();
+        case FigureType::Square:
+            return Square(decode<4>(*this, index)).area();
+        default:
+            return Rectangle(decode<4>(*this, index)).area();
+    }
+}
+
+std::pair<double, double> CompactFigureStore::geometricCenter(size_t index) const {
+    switch (types[index]) {
+        case FigureType::Triangle:
+            return Triangle(decode<3>(*this, index)).geometricCenter();
+        case FigureType::Square:
+            return Square(decode<4>(*this, index)).geometricCenter();
+        default:
+            return Rectangle(decode<4>(*this, index)).geometricCenter();
+    }
+}
+
+std::unique_ptr<Figure> CompactFigureStore::figure(size_t index) const {
+    switch (types[index]) {
+        case FigureType::Triangle:
+            return std::make_unique<Triangle>(decode<3>(*this, index));
+        case FigureType::Square:
+            return std::make_unique<Square>(decode<4>(*this, index));
+        default:
+            return std::make_unique<Rectangle>(decode<4>(*this, index));
+    }
+}
+
+double CompactFigureStore::totalArea() const {
+    double total = 0;
+    for (size_t i = 0; i < types.size(); ++i) {
+        total += area(i);
+    }
+    return total;
+}
+
+double CompactFigureStore::coordinateErrorBound(double magnitude) const {
+    if (mode == VertexStorage::Float32) {
+        return std::abs(magnitude) * std::numeric_limits<float>::epsilon() / 2.0;
+    }
+    return scale / 2.0;
+}
+
+size_t CompactFigureStore::memoryBytes() const {
+    return types.capacity() * sizeof(FigureType) +
+           floatCoords.capacity() * sizeof(float) +
+           fixedCoords.capacity() * sizeof(std::int32_t);
+}
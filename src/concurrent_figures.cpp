@@ -0,0 +1,199 @@
+#include "../include/concurrent_figures.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+size_t readerSlotIndex(size_t slots) {
+    static std::atomic<size_t> nextSlot{0};
+    thread_local size_t slot = nextSlot.fetch_add(1) % slots;
+    return slot;
+}
+
+void appendChunk(FigureSnapshot::Chunk& chunk, const FigureSnapshot::Chunk& tail) {
+    chunk.figures.insert(chunk.figures.end(), tail.figures.begin(), tail.figures.end());
+    chunk.ids.insert(chunk.ids.end(), tail.ids.begin(), tail.ids.end());
+    chunk.area += tail.area;
+}
+
+void refreshTotals(FigureSnapshot::Chunk& chunk) {
+    chunk.area = 0;
+    for (const auto& figure : chunk.figures) {
+        chunk.area += figure->area();
+    }
+}
+
+}
+
+ConcurrentFigureCollection::ReadSection::ReadSection(const ConcurrentFigureCollection& collection)
+    : counter(collection.readers[readerSlotIndex(kReaderSlots)].active[collection.epoch.load() & 1]) {
+    counter.fetch_add(1);
+}
+
+ConcurrentFigureCollection::ReadSection::~ReadSection() {
+    counter.fetch_sub(1);
+}
+
+ConcurrentFigureCollection::ConcurrentFigureCollection()
+    : epoch(0), current(new FigureSnapshot()), nextId(1) {
+    for (auto& slot : readers) {
+        slot.active[0].store(0);
+        slot.active[1].store(0);
+    }
+}
+
+ConcurrentFigureCollection::~ConcurrentFigureCollection() {
+    delete current.load();
+}
+
+std::uint64_t ConcurrentFigureCollection::insert(std::unique_ptr<Figure> figure) {
+    std::vector<std::unique_ptr<Figure>> batch;
+    batch.push_back(std::move(figure));
+    return insert(std::move(batch)).front();
+}
+
+std::vector<std::uint64_t> ConcurrentFigureCollection::insert(std::vector<std::unique_ptr<Figure>> figures) {
+    FIGURES_METRIC(Insert);
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto next = std::make_unique<FigureSnapshot>(*current.load());
+
+    std::vector<std::uint64_t> ids;
+    std::vector<size_t> chunkIndices;
+    std::shared_ptr<FigureSnapshot::Chunk> tail;
+    for (auto& figure : figures) {
+        if (!tail) {
+            if (!next->chunks.empty() && next->chunks.back()->figures.size() < kChunkSize) {
+                tail = std::make_shared<FigureSnapshot::Chunk>(*next->chunks.back());
+                next->chunks.back() = tail;
+            } else {
+                tail = std::make_shared<FigureSnapshot::Chunk>();
+                tail->figures.reserve(kChunkSize);
+                tail->ids.reserve(kChunkSize);
+                next->chunks.push_back(tail);
+            }
+        }
+        std::uint64_t id = nextId + ids.size();
+        tail->area += figure->area();
+        tail->figures.push_back(std::shared_ptr<const Figure>(std::move(figure)));
+        tail->ids.push_back(id);
+        ids.push_back(id);
+        chunkIndices.push_back(next->chunks.size() - 1);
+        if (tail->figures.size() == kChunkSize) {
+            tail.reset();
+        }
+    }
+
+    next->count += ids.size();
+    next->area = 0;
+    for (const auto& chunk : next->chunks) {
+        next->area += chunk->area;
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+        chunkOfId[ids[i]] = chunkIndices[i];
+    }
+    nextId += ids.size();
+    publish(next.release());
+    return ids;
+}
+
+bool ConcurrentFigureCollection::remove(std::uint64_t id) {
+    FIGURES_METRIC(Remove);
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto found = chunkOfId.find(id);
+    if (found == chunkOfId.end()) return false;
+
+    auto next = std::make_unique<FigureSnapshot>(*current.load());
+    size_t chunkIndex = found->second;
+    auto chunk = std::make_shared<FigureSnapshot::Chunk>(*next->chunks[chunkIndex]);
+    size_t position = std::find(chunk->ids.begin(), chunk->ids.end(), id) - chunk->ids.begin();
+    chunk->ids.erase(chunk->ids.begin() + position);
+    chunk->figures.erase(chunk->figures.begin() + position);
+    refreshTotals(*chunk);
+    chunkOfId.erase(found);
+
+    // Keep chunks from thinning out: an emptied chunk is dropped and one
+    // below a quarter full is merged with a neighbour that has room, so any
+    // removal pattern leaves O(size() / kChunkSize) chunks.
+    auto& chunks = next->chunks;
+    size_t moved = chunks.size();
+    if (chunk->figures.empty()) {
+        chunks.erase(chunks.begin() + chunkIndex);
+        moved = chunkIndex;
+    } else {
+        chunks[chunkIndex] = chunk;
+        auto fits = [&](size_t other) {
+            return chunks[other]->figures.size() + chunk->figures.size() <= kChunkSize;
+        };
+        size_t left = chunks.size();
+        if (chunk->figures.size() < kChunkSize / 4) {
+            if (chunkIndex + 1 < chunks.size() && fits(chunkIndex + 1)) {
+                left = chunkIndex;
+            } else if (chunkIndex > 0 && fits(chunkIndex - 1)) {
+                left = chunkIndex - 1;
+            }
+        }
+        if (left < chunks.size()) {
+            auto joined = std::make_shared<FigureSnapshot::Chunk>(*chunks[left]);
+            appendChunk(*joined, *chunks[left + 1]);
+            chunks[left] = joined;
+            chunks.erase(chunks.begin() + left + 1);
+            moved = left;
+        }
+    }
+    for (size_t c = moved; c < chunks.size(); ++c) {
+        for (std::uint64_t later : chunks[c]->ids) {
+            chunkOfId[later] = c;
+        }
+    }
+    next->count -= 1;
+    next->area = 0;
+    for (const auto& c : next->chunks) {
+        next->area += c->area;
+    }
+    publish(next.release());
+    return true;
+}
+
+size_t ConcurrentFigureCollection::size() const {
+    return read([](const FigureSnapshot& snapshot) { return snapshot.size(); });
+}
+
+double ConcurrentFigureCollection::totalArea() const {
+    FIGURES_METRIC(TotalArea);
+    return read([](const FigureSnapshot& snapshot) { return snapshot.totalArea(); });
+}
+
+void ConcurrentFigureCollection::publish(const FigureSnapshot* next) {
+    const FigureSnapshot* old = current.exchange(next);
+    // Flip the epoch twice so readers that picked up either parity before
+    // the exchange have drained, while new readers move to the other one.
+    unsigned e = epoch.load();
+    epoch.store(e + 1);
+    waitForReaders(e & 1);
+    epoch.store(e + 2);
+    waitForReaders((e + 1) & 1);
+    delete old;
+}
+
+void ConcurrentFigureCollection::waitForReaders(unsigned parity) {
+    for (;;) {
+        long active = 0;
+        for (const auto& slot : readers) {
+            active += slot.active[parity].load();
+        }
+        if (active == 0) return;
+        std::this_thread::yield();
+    }
+}
+
+void printAllFiguresInfo(const FigureSnapshot& snapshot) {
+    size_t i = 0;
+    snapshot.forEach([&i](std::uint64_t, const Figure& figure) {
+        std::cout << "Figure " << ++i << ":\n";
+        std::cout << "  " << figure << "\n";
+        auto center = figure.geometricCenter();
+        std::cout << "  Geometric center: (" << center.first << ", " << center.second << ")\n";
+        std::cout << "  Area: " << figure.area() << "\n\n";
+    });
+}
@@ -0,0 +1,472 @@
+#include "../include/figure_server.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+const std::uint64_t kListenTag = 0;
+const std::uint64_t kWakeTag = 1;
+const size_t kMaxLineLength = 64 * 1024;
+const size_t kReadChunk = 64 * 1024;
+// Per-connection backpressure: reading stops while this much input is
+// buffered or this much output is still unsent, and resumes once drained.
+const size_t kMaxBufferedInput = 1024 * 1024;
+const size_t kMaxPendingOutput = 1024 * 1024;
+// Lines taken from one connection per round; the rest wait for the next one
+// so a single pipelining client cannot monopolize a batch.
+const size_t kMaxRequestsPerRound = 256;
+// While out of descriptors the listen socket is unwatched; accepting is
+// retried when a connection closes or after this many milliseconds.
+const int kAcceptRetryMs = 100;
+
+[[noreturn]] void throwSystemError(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un makeAddress(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// True if nothing accepts connections on the socket at this address.
+bool isStaleSocket(const sockaddr_un& address) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return false;
+    bool stale = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 &&
+                 errno == ECONNREFUSED;
+    close(probe);
+    return stale;
+}
+
+std::string commandOf(const std::string& line) {
+    return line.substr(0, line.find(' '));
+}
+
+bool isReadCommand(const std::string& command) {
+    return command == "TOTAL" || command == "COUNT" || command == "REPORT";
+}
+
+std::unique_ptr<Figure> parseFigure(std::istream& is) {
+    std::string type;
+    is >> type;
+    std::unique_ptr<Figure> figure;
+    if (type == "TRIANGLE") {
+        figure = std::make_unique<Triangle>();
+    } else if (type == "SQUARE") {
+        figure = std::make_unique<Square>();
+    } else if (type == "RECTANGLE") {
+        figure = std::make_unique<Rectangle>();
+    } else {
+        return nullptr;
+    }
+    if (!(is >> *figure) || !(is >> std::ws).eof()) {
+        return nullptr;
+    }
+    return figure;
+}
+
+}
+
+struct FigureServer::Connection {
+    int fd;
+    std::string in;
+    std::string out;
+    // Set once the peer stops sending; lines already buffered are still answered.
+    bool closing = false;
+    // Complete lines are left in `in` for a later round.
+    bool backlogged = false;
+    bool dirty = false;
+    std::uint32_t events = EPOLLIN;
+};
+
+struct FigureServer::Request {
+    std::uint64_t connection;
+    std::string line;
+};
+
+FigureServer::FigureServer(const std::string& socketPath)
+    : path(socketPath), listenFd(-1), epollFd(-1), wakeFd(-1), nextConnectionId(2),
+      acceptPaused(false) {
+    sockaddr_un address = makeAddress(path);
+    auto fail = [this](const std::string& what) {
+        int saved = errno;
+        if (wakeFd >= 0) close(wakeFd);
+        if (epollFd >= 0) close(epollFd);
+        if (listenFd >= 0) close(listenFd);
+        errno = saved;
+        throwSystemError(what);
+    };
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) fail("socket");
+    // Only a socket left behind by a previous run may be replaced.
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            errno = EEXIST;
+            fail("bind " + path + " (not a socket)");
+        }
+        if (!isStaleSocket(address)) {
+            errno = EADDRINUSE;
+            fail("bind " + path);
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) fail("bind " + path);
+    if (listen(listenFd, SOMAXCONN) < 0) fail("listen");
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) fail("epoll_create1");
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) fail("eventfd");
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = kListenTag;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) fail("epoll_ctl");
+    event.data.u64 = kWakeTag;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) fail("epoll_ctl");
+}
+
+FigureServer::~FigureServer() {
+    for (auto& entry : connections) {
+        close(entry.second->fd);
+    }
+    close(wakeFd);
+    close(epollFd);
+    close(listenFd);
+    unlink(path.c_str());
+}
+
+void FigureServer::stop() {
+    std::uint64_t one = 1;
+    // Only write(), so this stays async-signal-safe.
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void FigureServer::run() {
+    std::vector<epoll_event> events(128);
+    std::vector<Request> requests;
+    std::vector<std::uint64_t> dirty;
+    std::vector<std::uint64_t> retry;
+    bool running = true;
+
+    while (running) {
+        // Backlogged connections have lines ready, so do not block for events.
+        int timeout = !backlog.empty() ? 0 : acceptPaused ? kAcceptRetryMs : -1;
+        int ready = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            throwSystemError("epoll_wait");
+        }
+        if (ready == 0 && acceptPaused) watchListener(true);
+
+        requests.clear();
+        dirty.clear();
+        retry.swap(backlog);
+        backlog.clear();
+        for (std::uint64_t id : retry) {
+            auto found = connections.find(id);
+            if (found == connections.end()) continue;
+            found->second->dirty = true;
+            dirty.push_back(id);
+            readRequests(id, *found->second, requests);
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            std::uint64_t tag = events[i].data.u64;
+            if (tag == kListenTag) {
+                acceptConnections();
+                continue;
+            }
+            if (tag == kWakeTag) {
+                std::uint64_t value;
+                ssize_t ignored = read(wakeFd, &value, sizeof(value));
+                (void)ignored;
+                running = false;
+                continue;
+            }
+            auto found = connections.find(tag);
+            if (found == connections.end()) continue;
+            Connection& connection = *found->second;
+            if (connection.dirty) continue;
+            connection.dirty = true;
+            dirty.push_back(tag);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readRequests(tag, connection, requests);
+            }
+        }
+
+        executeBatch(requests);
+
+        for (std::uint64_t id : dirty) {
+            auto found = connections.find(id);
+            if (found == connections.end()) continue;
+            found->second->dirty = false;
+            flushConnection(id, *found->second);
+        }
+    }
+
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->first);
+    }
+}
+
+void FigureServer::acceptConnections() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            // The pending connection stays queued, so a level-triggered
+            // listen socket would wake every round until a descriptor frees up.
+            if (errno == EMFILE || errno == ENFILE) watchListener(false);
+            return;
+        }
+        std::uint64_t id = nextConnectionId++;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connections.emplace(id, std::move(connection));
+    }
+}
+
+void FigureServer::readRequests(std::uint64_t id, Connection& connection, std::vector<Request>& requests) {
+    if (connection.out.size() >= kMaxPendingOutput) return;
+
+    char buffer[kReadChunk];
+    while (!connection.closing && connection.in.size() < kMaxBufferedInput) {
+        ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            connection.in.append(buffer, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            connection.closing = true;
+        }
+        break;
+    }
+
+    size_t start = 0, taken = 0;
+    connection.backlogged = false;
+    for (size_t end; (end = connection.in.find('\n', start)) != std::string::npos; start = end + 1) {
+        if (taken == kMaxRequestsPerRound) {
+            connection.backlogged = true;
+            break;
+        }
+        size_t length = end - start;
+        if (length > 0 && connection.in[end - 1] == '\r') --length;
+        if (length > 0) {
+            requests.push_back({id, connection.in.substr(start, length)});
+            ++taken;
+        }
+    }
+    connection.in.erase(0, start);
+
+    if (!connection.backlogged && connection.in.size() > kMaxLineLength) {
+        connection.in.clear();
+        connection.out += "ERR line too long\n";
+        connection.closing = true;
+    }
+}
+
+void FigureServer::executeBatch(const std::vector<Request>& requests) {
+    auto respond = [this](const Request& request, const std::string& text) {
+        auto found = connections.find(request.connection);
+        if (found != connections.end()) {
+            found->second->out += text;
+            found->second->out += '\n';
+        }
+    };
+
+    size_t i = 0;
+    while (i < requests.size()) {
+        std::string command = commandOf(requests[i].line);
+        size_t end = i + 1;
+
+        if (command == "ADD") {
+            while (end < requests.size() && commandOf(requests[end].line) == "ADD") ++end;
+            std::vector<std::unique_ptr<Figure>> batch;
+            std::vector<bool> valid;
+            for (size_t j = i; j < end; ++j) {
+                std::istringstream is(requests[j].line.substr(3));
+                auto figure = parseFigure(is);
+                valid.push_back(figure != nullptr);
+                if (figure) batch.push_back(std::move(figure));
+            }
+            std::vector<std::uint64_t> ids;
+            if (!batch.empty()) ids = figures.insert(std::move(batch));
+            size_t next = 0;
+            for (size_t j = i; j < end; ++j) {
+                respond(requests[j], valid[j - i] ? "OK " + std::to_string(ids[next++])
+                                                  : std::string("ERR bad figure"));
+            }
+        } else if (isReadCommand(command)) {
+            while (end < requests.size() && isReadCommand(commandOf(requests[end].line))) ++end;
+            figures.read([&](const FigureSnapshot& snapshot) {
+                for (size_t j = i; j < end; ++j) {
+                    std::ostringstream os;
+                    os.precision(17);
+                    const std::string& line = requests[j].line;
+                    if (line == "TOTAL") {
+                        os << "OK " << snapshot.totalArea();
+                    } else if (line == "COUNT") {
+                        os << "OK " << snapshot.size();
+                    } else if (line == "REPORT") {
+                        snapshot.forEach([&os](std::uint64_t id, const Figure& figure) {
+                            auto center = figure.geometricCenter();
+                            os << "FIGURE " << id << ' ' << figure.area() << ' '
+                               << center.first << ' ' << center.second << '\n';
+                        });
+                        os << "OK " << snapshot.size();
+                    } else {
+                        os << "ERR unexpected arguments";
+                    }
+                    respond(requests[j], os.str());
+                }
+            });
+        } else if (command == "REMOVE") {
+            std::istringstream is(requests[i].line.substr(6));
+            std::uint64_t id;
+            if (!(is >> id) || !(is >> std::ws).eof()) {
+                respond(requests[i], "ERR bad id");
+            } else {
+                respond(requests[i], figures.remove(id) ? "OK" : "ERR not found");
+            }
+        } else {
+            respond(requests[i], "ERR unknown command");
+        }
+        i = end;
+    }
+}
+
+void FigureServer::flushConnection(std::uint64_t id, Connection& connection) {
+    size_t written = 0;
+    while (written < connection.out.size()) {
+        ssize_t n = send(connection.fd, connection.out.data() + written,
+                         connection.out.size() - written, MSG_NOSIGNAL);
+        if (n > 0) {
+            written += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closeConnection(id);
+        return;
+    }
+    connection.out.erase(0, written);
+
+    if (connection.out.empty() && connection.closing && !connection.backlogged) {
+        closeConnection(id);
+        return;
+    }
+    bool canProcess = connection.out.size() < kMaxPendingOutput;
+    if (connection.backlogged && canProcess) {
+        backlog.push_back(id);
+    }
+
+    // EPOLLIN only while more input is welcome; once the peer has closed,
+    // level-triggered EOF would otherwise wake every round.
+    std::uint32_t wanted = 0;
+    if (!connection.closing && canProcess && connection.in.size() < kMaxBufferedInput) {
+        wanted |= EPOLLIN;
+    }
+    if (!connection.out.empty()) wanted |= EPOLLOUT;
+    if (wanted != connection.events) {
+        epoll_event event{};
+        event.events = wanted;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = wanted;
+    }
+}
+
+void FigureServer::closeConnection(std::uint64_t id) {
+    auto found = connections.find(id);
+    if (found == connections.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, found->second->fd, nullptr);
+    close(found->second->fd);
+    connections.erase(found);
+    if (acceptPaused) watchListener(true);
+}
+
+void FigureServer::watchListener(bool watch) {
+    epoll_event event{};
+    if (watch) event.events = EPOLLIN;
+    event.data.u64 = kListenTag;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, listenFd, &event);
+    acceptPaused = !watch;
+}
+
+FigureClient::FigureClient(const std::string& socketPath) : fd(-1) {
+    sockaddr_un address = makeAddress(socketPath);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throwSystemError("socket");
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        throwSystemError("connect " + socketPath);
+    }
+}
+
+FigureClient::~FigureClient() {
+    close(fd);
+}
+
+void FigureClient::send(const std::string& line) {
+    outgoing += line;
+    outgoing += '\n';
+}
+
+void FigureClient::finish() {
+    flush();
+    if (shutdown(fd, SHUT_WR) < 0) throwSystemError("shutdown");
+}
+
+void FigureClient::flush() {
+    size_t written = 0;
+    while (written < outgoing.size()) {
+        ssize_t n = ::send(fd, outgoing.data() + written, outgoing.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throwSystemError("send");
+        }
+        written += static_cast<size_t>(n);
+    }
+    outgoing.clear();
+}
+
+std::string FigureClient::readLine() {
+    size_t end;
+    while ((end = incoming.find('\n')) == std::string::npos) {
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throwSystemError("recv");
+        if (n == 0) throw std::runtime_error("Connection closed by server");
+        incoming.append(buffer, static_cast<size_t>(n));
+    }
+    std::string line = incoming.substr(0, end);
+    incoming.erase(0, end + 1);
+    return line;
+}
@@ -1,4 +1,12 @@
 #include "../include/figures.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 Figure::operator double() const {
     return area();
@@ -22,12 +30,14 @@ Triangle::Triangle(const Triangle& other) : vertices(other.vertices) {}
 Triangle::Triangle(Triangle&& other) noexcept : vertices(std::move(other.vertices)) {}
 
 std::pair<double, double> Triangle::geometricCenter() const {
+    FIGURES_METRIC(GeometricCenter);
     double centerX = (vertices[0].first + vertices[1].first + vertices[2].first) / 3.0;
     double centerY = (vertices[0].second + vertices[1].second + vertices[2].second) / 3.0;
     return {centerX, centerY};
 }
 
 double Triangle::area() const {
+    FIGURES_METRIC(Area);
     double x1 = vertices[0].first, y1 = vertices[0].second;
     double x2 = vertices[1].first, y2 = vertices[1].second;
     double x3 = vertices[2].first, y3 = vertices[2].second;
@@ -36,6 +46,7 @@ double Triangle::area() const {
 }
 
 void Triangle::printVertices(std::ostream& os) const {
+    FIGURES_METRIC(Print);
     os << "Triangle vertices: ";
     for (const auto& vertex : vertices) {
         os << "(" << vertex.first << ", " << vertex.second << ") ";
@@ -43,6 +54,7 @@ void Triangle::printVertices(std::ostream& os) const {
 }
 
 void Triangle::readVertices(std::istream& is) {
+    FIGURES_METRIC(Parse);
     for (int i = 0; i < 3; ++i) {
         double x, y;
         is >> x >> y;
@@ -94,6 +106,7 @@ Square::Square(const Square& other) : vertices(other.vertices) {}
 Square::Square(Square&& other) noexcept : vertices(std::move(other.vertices)) {}
 
 std::pair<double, double> Square::geometricCenter() const {
+    FIGURES_METRIC(GeometricCenter);
     double centerX = 0, centerY = 0;
     for (const auto& vertex : vertices) {
         centerX += vertex.first;
@@ -103,6 +116,7 @@ std::pair<double, double> Square::geometricCenter() const {
 }
 
 double Square::area() const {
+    FIGURES_METRIC(Area);
     double minSide = std::numeric_limits<double>::max();
     
     for (int i = 0; i < 4; i++) {
@@ -119,6 +133,7 @@ double Square::area() const {
 }
 
 void Square::printVertices(std::ostream& os) const {
+    FIGURES_METRIC(Print);
     os << "Square vertices: ";
     for (const auto& vertex : vertices) {
         os << "(" << vertex.first << ", " << vertex.second << ") ";
@@ -126,11 +141,21 @@ void Square::printVertices(std::ostream& os) const {
 }
 
 void Square::readVertices(std::istream& is) {
+    FIGURES_METRIC(Parse);
+    std::array<std::pair<double, double>, 4> points;
     for (int i = 0; i < 4; ++i) {
         double x, y;
         is >> x >> y;
-        vertices[i] = {x, y};
+        points[i] = {x, y};
+    }
+    if (is && rejectInvalidOnRead()) {
+        QuadrilateralKind kind = classifyQuadrilateral(points, rejectInvalidTolerance());
+        if (!(kind == QuadrilateralKind::Square)) {
+            is.setstate(std::ios::failbit);
+            return;
+        }
     }
+    vertices = points;
 }
 
 bool Square::operator==(const Figure& other) const {
@@ -177,6 +202,7 @@ Rectangle::Rectangle(const Rectangle& other) : vertices(other.vertices) {}
 Rectangle::Rectangle(Rectangle&& other) noexcept : vertices(std::move(other.vertices)) {}
 
 std::pair<double, double> Rectangle::geometricCenter() const {
+    FIGURES_METRIC(GeometricCenter);
     double centerX = 0, centerY = 0;
     for (const auto& vertex : vertices) {
         centerX += vertex.first;
@@ -186,6 +212,7 @@ std::pair<double, double> Rectangle::geometricCenter() const {
 }
 
 double Rectangle::area() const {
+    FIGURES_METRIC(Area);
     double area = 0;
     for (int i = 0; i < 4; i++) {
         int j = (i + 1) % 4;
@@ -196,6 +223,7 @@ double Rectangle::area() const {
 }
 
 void Rectangle::printVertices(std::ostream& os) const {
+    FIGURES_METRIC(Print);
     os << "Rectangle vertices: ";
     for (const auto& vertex : vertices) {
         os << "(" << vertex.first << ", " << vertex.second << ") ";
@@ -203,11 +231,21 @@ void Rectangle::printVertices(std::ostream& os) const {
 }
 
 void Rectangle::readVertices(std::istream& is) {
+    FIGURES_METRIC(Parse);
+    std::array<std::pair<double, double>, 4> points;
     for (int i = 0; i < 4; ++i) {
         double x, y;
         is >> x >> y;
-        vertices[i] = {x, y};
+        points[i] = {x, y};
     }
+    if (is && rejectInvalidOnRead()) {
+        QuadrilateralKind kind = classifyQuadrilateral(points, rejectInvalidTolerance());
+        if (!(kind == QuadrilateralKind::Square || kind == QuadrilateralKind::Rectangle)) {
+            is.setstate(std::ios::failbit);
+            return;
+        }
+    }
+    vertices = points;
 }
 
 bool Rectangle::operator==(const Figure& other) const {
@@ -236,6 +274,334 @@ std::unique_ptr<Figure> Rectangle::clone() const {
     return std::make_unique<Rectangle>(*this);
 }
 
+namespace {
+
+// By-value min/max: std::min/std::max return references, which keeps the
+// classification loop from being if-converted and vectorized.
+inline double minOf(double a, double b) { return b < a ? b : a; }
+inline double maxOf(double a, double b) { return a < b ? b : a; }
+
+}
+
+void classifyQuadrilaterals(const double* xs, const double* ys, size_t count,
+                            QuadrilateralKind* kinds, double tolerance) {
+    // Straight-line body over a vertex-major layout so the compiler can
+    // process several quads per instruction. Flags and codes stay in double
+    // lanes inside the loop (SSE2 has no 64-bit integer select), and are
+    // narrowed to QuadrilateralKind once per block.
+    const size_t kBlock = 64;
+    double codes[kBlock];
+    const double* x0 = xs;
+    const double* x1 = xs + count;
+    const double* x2 = xs + 2 * count;
+    const double* x3 = xs + 3 * count;
+    const double* y0 = ys;
+    const double* y1 = ys + count;
+    const double* y2 = ys + 2 * count;
+    const double* y3 = ys + 3 * count;
+    for (size_t base = 0; base < count; base += kBlock) {
+        size_t end = std::min(count, base + kBlock);
+        for (size_t q = base; q < end; ++q) {
+            double x[4] = {x0[q], x1[q], x2[q], x3[q]};
+            double y[4] = {y0[q], y1[q], y2[q], y3[q]};
+
+            double ex[4], ey[4], len2[4];
+            for (int i = 0; i < 4; ++i) {
+                int j = (i + 1) & 3;
+                ex[i] = x[j] - x[i];
+                ey[i] = y[j] - y[i];
+                len2[i] = ex[i] * ex[i] + ey[i] * ey[i];
+            }
+            double maxLen2 = maxOf(maxOf(len2[0], len2[1]), maxOf(len2[2], len2[3]));
+            double minLen2 = minOf(minOf(len2[0], len2[1]), minOf(len2[2], len2[3]));
+            double eps = tolerance * maxLen2;
+
+            double isPositive[4], isNegative[4];
+            double minCross = std::numeric_limits<double>::max(), maxDot = 0;
+            double doubledArea = 0;
+            for (int i = 0; i < 4; ++i) {
+                int k = (i + 3) & 3;
+                double cross = ex[k] * ey[i] - ey[k] * ex[i];
+                double dot = ex[k] * ex[i] + ey[k] * ey[i];
+                isPositive[i] = cross > eps ? 1.0 : 0.0;
+                isNegative[i] = cross < -eps ? 1.0 : 0.0;
+                minCross = minOf(minCross, std::abs(cross));
+                maxDot = maxOf(maxDot, std::abs(dot));
+                doubledArea += x[i] * y[(i + 1) & 3] - x[(i + 1) & 3] * y[i];
+            }
+
+            // Summed outside the loop: a conditional += counts as a possibly
+            // trapping add and blocks if-conversion.
+            double positive = isPositive[0] + isPositive[1] + isPositive[2] + isPositive[3];
+            double negative = isNegative[0] + isNegative[1] + isNegative[2] + isNegative[3];
+
+            // Each test is a single select, applied from lowest to highest
+            // priority. positive + negative <= 4, so min == 2 means a bow-tie
+            // and max == 4 means convex. A bow-tie can have zero signed area,
+            // so crossing overrides the area check.
+            const double general = static_cast<double>(QuadrilateralKind::General);
+            const double degenerate = static_cast<double>(QuadrilateralKind::Degenerate);
+            double shape = std::abs(len2[0] - len2[1]) <= eps
+                               ? static_cast<double>(QuadrilateralKind::Square)
+                               : static_cast<double>(QuadrilateralKind::Rectangle);
+            double kind = maxDot <= eps ? shape : general;
+            kind = maxOf(positive, negative) == 4 ? kind : general;
+            kind = std::abs(doubledArea) <= eps ? degenerate : kind;
+            kind = minOf(positive, negative) == 2
+                       ? static_cast<double>(QuadrilateralKind::SelfIntersecting)
+                       : kind;
+            kind = minCross <= eps ? degenerate : kind;
+            kind = minLen2 <= tolerance * tolerance * maxLen2 ? degenerate : kind;
+            codes[q - base] = kind;
+        }
+        for (size_t q = base; q < end; ++q) {
+            kinds[q] = static_cast<QuadrilateralKind>(codes[q - base]);
+        }
+    }
+}
+
+QuadrilateralKind classifyQuadrilateral(const std::array<std::pair<double, double>, 4>& vertices,
+                                        double tolerance) {
+    double xs[4], ys[4];
+    for (int i = 0; i < 4; ++i) {
+        xs[i] = vertices[i].first;
+        ys[i] = vertices[i].second;
+    }
+    QuadrilateralKind kind;
+    classifyQuadrilaterals(xs, ys, 1, &kind, tolerance);
+    return kind;
+}
+
+ValidationReport validateFigures(const std::vector<Figure*>& figures, double tolerance) {
+    std::vector<size_t> indices;
+    std::vector<bool> squareOnly;
+    std::vector<const std::array<std::pair<double, double>, 4>*> quads;
+    for (size_t i = 0; i < figures.size(); ++i) {
+        const std::array<std::pair<double, double>, 4>* vertices = nullptr;
+        bool isSquare = false;
+        if (const Square* square = dynamic_cast<const Square*>(figures[i])) {
+            vertices = &square->getVertices();
+            isSquare = true;
+        } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(figures[i])) {
+            vertices = &rect->getVertices();
+        }
+        if (!vertices) continue;
+        quads.push_back(vertices);
+        indices.push_back(i);
+        squareOnly.push_back(isSquare);
+    }
+
+    size_t count = quads.size();
+    std::vector<double> xs(4 * count), ys(4 * count);
+    for (size_t q = 0; q < count; ++q) {
+        for (size_t k = 0; k < 4; ++k) {
+            xs[k * count + q] = (*quads[q])[k].first;
+            ys[k * count + q] = (*quads[q])[k].second;
+        }
+    }
+
+    std::vector<QuadrilateralKind> kinds(count);
+    classifyQuadrilaterals(xs.data(), ys.data(), count, kinds.data(), tolerance);
+
+    ValidationReport report;
+    for (size_t q = 0; q < indices.size(); ++q) {
+        bool valid = kinds[q] == QuadrilateralKind::Square ||
+                     (!squareOnly[q] && kinds[q] == QuadrilateralKind::Rectangle);
+        if (!valid) {
+            report.invalidIndices.push_back(indices[q]);
+            report.invalidKinds.push_back(kinds[q]);
+        }
+    }
+    return report;
+}
+
+static bool rejectInvalid = false;
+static double rejectTolerance = kDefaultReadTolerance;
+
+void setRejectInvalidOnRead(bool enabled, double tolerance) {
+    rejectInvalid = enabled;
+    rejectTolerance = tolerance;
+}
+
+bool rejectInvalidOnRead() {
+    return rejectInvalid;
+}
+
+double rejectInvalidTolerance() {
+    return rejectTolerance;
+}
+
+namespace {
+
+struct FigureKey {
+    int vertexCount = 0;
+    int type = 0;
+    std::array<std::uint64_t, 8> coords{};
+
+    bool operator==(const FigureKey& other) const {
+        return type == other.type && coords == other.coords;
+    }
+};
+
+struct FigureKeyHash {
+    size_t operator()(const FigureKey& key) const {
+        std::uint64_t h = 0x9e3779b97f4a7c15ULL ^ static_cast<std::uint64_t>(key.type);
+        for (int i = 0; i < 2 * key.vertexCount; ++i) {
+            h ^= key.coords[i] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+};
+
+std::uint64_t coordinateBits(double value, double quantum) {
+    if (quantum > 0) {
+        return static_cast<std::uint64_t>(static_cast<std::int64_t>(std::llround(value / quantum)));
+    }
+    if (value == 0) return 0;
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template <size_t N>
+void canonicalize(const std::array<std::pair<double, double>, N>& vertices, double quantum,
+                  FigureKey& key) {
+    std::array<std::pair<std::uint64_t, std::uint64_t>, N> points;
+    for (size_t i = 0; i < N; ++i) {
+        points[i] = {coordinateBits(vertices[i].first, quantum),
+                     coordinateBits(vertices[i].second, quantum)};
+    }
+
+    std::array<std::pair<std::uint64_t, std::uint64_t>, N> best = points;
+    std::array<std::pair<std::uint64_t, std::uint64_t>, N> candidate;
+    for (size_t start = 0; start < N; ++start) {
+        for (size_t i = 0; i < N; ++i) candidate[i] = points[(start + i) % N];
+        if (candidate < best) best = candidate;
+        for (size_t i = 0; i < N; ++i) candidate[i] = points[(start + N - i) % N];
+        if (candidate < best) best = candidate;
+    }
+
+    key.vertexCount = static_cast<int>(N);
+    for (size_t i = 0; i < N; ++i) {
+        key.coords[2 * i] = best[i].first;
+        key.coords[2 * i + 1] = best[i].second;
+    }
+}
+
+FigureKey makeFigureKey(const Figure& figure, double quantum) {
+    FigureKey key;
+    if (const Triangle* tri = dynamic_cast<const Triangle*>(&figure)) {
+        key.type = 1;
+        canonicalize(tri->getVertices(), quantum, key);
+    } else if (const Square* square = dynamic_cast<const Square*>(&figure)) {
+        key.type = 2;
+        canonicalize(square->getVertices(), quantum, key);
+    } else if (const Rectangle* rect = dynamic_cast<const Rectangle*>(&figure)) {
+        key.type = 3;
+        canonicalize(rect->getVertices(), quantum, key);
+    } else {
+        // Vertices of other subclasses are not reachable through Figure, so
+        // such a figure only matches itself.
+        key.vertexCount = 1;
+        key.coords[0] = reinterpret_cast<std::uintptr_t>(&figure);
+    }
+    return key;
+}
+
+unsigned resolveThreadCount(unsigned threadCount) {
+    return threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Below this many items per thread, starting the threads costs more than
+// the work they would share.
+const size_t kMinParallelChunk = 1024;
+
+template <typename Body>
+void parallelChunks(size_t count, unsigned threadCount, Body body) {
+    size_t chunks = std::min<size_t>(threadCount, count / kMinParallelChunk);
+    if (chunks <= 1) {
+        body(0, 0, count);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < chunks; ++c) {
+        workers.emplace_back(body, c, count * c / chunks, count * (c + 1) / chunks);
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+}
+
+size_t figureHash(const Figure& figure, double quantum) {
+    return FigureKeyHash()(makeFigureKey(figure, quantum));
+}
+
+bool sameFigure(const Figure& a, const Figure& b, double quantum) {
+    return makeFigureKey(a, quantum) == makeFigureKey(b, quantum);
+}
+
+std::vector<size_t> findDuplicateFigures(const std::vector<Figure*>& figures, double quantum,
+                                         unsigned threadCount) {
+    const size_t shardCount = 64;
+    threadCount = resolveThreadCount(threadCount);
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<FigureKey, size_t, FigureKeyHash> firstIndex;
+    };
+    std::vector<Shard> shards(shardCount);
+    std::vector<FigureKey> keys(figures.size());
+    std::vector<size_t> hashes(figures.size());
+
+    // Each shard keeps the smallest index seen per key, so the result does not
+    // depend on thread scheduling.
+    parallelChunks(figures.size(), threadCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            keys[i] = makeFigureKey(*figures[i], quantum);
+            hashes[i] = FigureKeyHash()(keys[i]);
+            Shard& shard = shards[hashes[i] % shardCount];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto inserted = shard.firstIndex.emplace(keys[i], i);
+            if (!inserted.second && i < inserted.first->second) {
+                inserted.first->second = i;
+            }
+        }
+    });
+
+    std::vector<std::vector<size_t>> partial(threadCount);
+    parallelChunks(figures.size(), threadCount, [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Shard& shard = shards[hashes[i] % shardCount];
+            if (shard.firstIndex.find(keys[i])->second != i) {
+                partial[chunk].push_back(i);
+            }
+        }
+    });
+
+    std::vector<size_t> duplicates;
+    for (const auto& part : partial) {
+        duplicates.insert(duplicates.end(), part.begin(), part.end());
+    }
+    return duplicates;
+}
+
+size_t removeDuplicateFigures(std::vector<Figure*>& figures, double quantum, unsigned threadCount) {
+    std::vector<size_t> duplicates = findDuplicateFigures(figures, quantum, threadCount);
+    size_t next = 0, out = 0;
+    for (size_t i = 0; i < figures.size(); ++i) {
+        if (next < duplicates.size() && duplicates[next] == i) {
+            delete figures[i];
+            ++next;
+        } else {
+            figures[out++] = figures[i];
+        }
+    }
+    figures.resize(out);
+    return duplicates.size();
+}
+
 std::ostream& operator<<(std::ostream& os, const Figure& figure) {
     figure.printVertices(os);
     return os;
@@ -247,6 +613,7 @@ std::istream& operator>>(std::istream& is, Figure& figure) {
 }
 
 double calculateTotalArea(const std::vector<Figure*>& figures) {
+    FIGURES_METRIC(TotalArea);
     double total = 0;
     for (const auto& figure : figures) {
         total += figure->area();
@@ -265,6 +632,7 @@ void printAllFiguresInfo(const std::vector<Figure*>& figures) {
 }
 
 void removeFigureByIndex(std::vector<Figure*>& figures, size_t index) {
+    FIGURES_METRIC(Remove);
     if (index < figures.size()) {
         delete figures[index];
         figures.erase(figures.begin() + index);
@@ -0,0 +1,193 @@
+#include "../include/metrics.hpp"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <algorithm>
+
+namespace {
+
+struct MetricCell {
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> totalNs{0};
+    std::atomic<std::uint64_t> maxNs{0};
+    std::array<std::atomic<std::uint64_t>, kHistogramBuckets> buckets{};
+};
+
+// Threads link themselves into the registry rather than being kept in a
+// vector, so registering a thread does not allocate.
+struct ThreadMetrics {
+    std::array<MetricCell, kMetricCount> cells;
+    ThreadMetrics* prev = nullptr;
+    ThreadMetrics* next = nullptr;
+};
+
+struct Registry {
+    std::mutex mutex;
+    ThreadMetrics* live = nullptr;
+    std::array<MetricSummary, kMetricCount> retired;
+};
+
+// Built in static storage and never destroyed: thread_local handles may be
+// destroyed after statics.
+Registry& registry() {
+    alignas(Registry) static unsigned char storage[sizeof(Registry)];
+    static Registry* instance = new (storage) Registry();
+    return *instance;
+}
+
+void accumulate(MetricSummary& summary, const MetricCell& cell) {
+    summary.count += cell.count.load(std::memory_order_relaxed);
+    summary.totalNs += cell.totalNs.load(std::memory_order_relaxed);
+    summary.maxNs = std::max(summary.maxNs, cell.maxNs.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < kHistogramBuckets; ++b) {
+        summary.buckets[b] += cell.buckets[b].load(std::memory_order_relaxed);
+    }
+}
+
+void clear(MetricCell& cell) {
+    cell.count.store(0, std::memory_order_relaxed);
+    cell.totalNs.store(0, std::memory_order_relaxed);
+    cell.maxNs.store(0, std::memory_order_relaxed);
+    for (auto& bucket : cell.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+class ThreadHandle {
+public:
+    ThreadMetrics metrics;
+
+    ThreadHandle() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        metrics.next = r.live;
+        if (r.live) r.live->prev = &metrics;
+        r.live = &metrics;
+    }
+
+    ~ThreadHandle() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t m = 0; m < kMetricCount; ++m) {
+            accumulate(r.retired[m], metrics.cells[m]);
+        }
+        if (metrics.prev) metrics.prev->next = metrics.next;
+        else r.live = metrics.next;
+        if (metrics.next) metrics.next->prev = metrics.prev;
+    }
+};
+
+ThreadMetrics& threadMetrics() {
+    thread_local ThreadHandle handle;
+    return handle.metrics;
+}
+
+// Only the owning thread writes its cells, so a plain load/store is enough.
+void bump(std::atomic<std::uint64_t>& counter, std::uint64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+size_t bucketOf(std::uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (nanoseconds > 1 && bucket + 1 < kHistogramBuckets) {
+        nanoseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+}
+
+std::uint64_t MetricSummary::quantileNs(double quantile) const {
+    if (count == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(quantile * (count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (size_t b = 0; b < kHistogramBuckets; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            return std::min(maxNs, (std::uint64_t(1) << (b + 1)) - 1);
+        }
+    }
+    return maxNs;
+}
+
+const char* metricName(Metric metric) {
+    switch (metric) {
+        case Metric::Area: return "area";
+        case Metric::GeometricCenter: return "geometric_center";
+        case Metric::Parse: return "parse";
+        case Metric::Print: return "print";
+        case Metric::Insert: return "insert";
+        case Metric::Remove: return "remove";
+        default: return "total_area";
+    }
+}
+
+void recordMetric(Metric metric, std::uint64_t nanoseconds) {
+    MetricCell& cell = threadMetrics().cells[static_cast<size_t>(metric)];
+    bump(cell.count, 1);
+    bump(cell.totalNs, nanoseconds);
+    if (nanoseconds > cell.maxNs.load(std::memory_order_relaxed)) {
+        cell.maxNs.store(nanoseconds, std::memory_order_relaxed);
+    }
+    bump(cell.buckets[bucketOf(nanoseconds)], 1);
+}
+
+std::array<MetricSummary, kMetricCount> collectMetrics() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::array<MetricSummary, kMetricCount> summaries = r.retired;
+    for (const ThreadMetrics* metrics = r.live; metrics; metrics = metrics->next) {
+        for (size_t m = 0; m < kMetricCount; ++m) {
+            accumulate(summaries[m], metrics->cells[m]);
+        }
+    }
+    return summaries;
+}
+
+void resetMetrics() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.retired = {};
+    for (ThreadMetrics* metrics = r.live; metrics; metrics = metrics->next) {
+        for (auto& cell : metrics->cells) {
+            clear(cell);
+        }
+    }
+}
+
+void dumpMetricsText(std::ostream& os) {
+    auto summaries = collectMetrics();
+    os << "Metrics (" << (kMetricsEnabled ? "enabled" : "compiled out") << "):\n";
+    for (size_t m = 0; m < kMetricCount; ++m) {
+        const MetricSummary& s = summaries[m];
+        os << "  " << metricName(static_cast<Metric>(m)) << ": count=" << s.count;
+        if (s.count > 0) {
+            os << " mean_ns=" << s.totalNs / s.count
+               << " p50_ns=" << s.quantileNs(0.5)
+               << " p99_ns=" << s.quantileNs(0.99)
+               << " max_ns=" << s.maxNs;
+        }
+        os << "\n";
+    }
+}
+
+void dumpMetricsJson(std::ostream& os) {
+    auto summaries = collectMetrics();
+    os << "{\"enabled\": " << (kMetricsEnabled ? "true" : "false") << ", \"metrics\": {";
+    for (size_t m = 0; m < kMetricCount; ++m) {
+        const MetricSummary& s = summaries[m];
+        os << (m ? ", " : "") << "\"" << metricName(static_cast<Metric>(m)) << "\": {"
+           << "\"count\": " << s.count
+           << ", \"total_ns\": " << s.totalNs
+           << ", \"max_ns\": " << s.maxNs
+           << ", \"p50_ns\": " << s.quantileNs(0.5)
+           << ", \"p99_ns\": " << s.quantileNs(0.99)
+           << ", \"histogram_ns\": [";
+        for (size_t b = 0; b < kHistogramBuckets; ++b) {
+            os << (b ? ", " : "") << s.buckets[b];
+        }
+        os << "]}";
+    }
+    os << "}}\n";
+}
@@ -0,0 +1,181 @@
+#include "../include/polygons.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+
+namespace {
+
+double doubledSignedArea(const double* x, const double* y, size_t n) {
+    if (n < 3) return 0;
+    double sum = 0;
+    for (size_t k = 0; k + 1 < n; ++k) {
+        sum += x[k] * y[k + 1] - x[k + 1] * y[k];
+    }
+    return sum + (x[n - 1] * y[0] - x[0] * y[n - 1]);
+}
+
+// Centroid over edges taken relative to vertex 0: the two edges touching it
+// have a zero cross product, so only edges (k, k + 1) for 1 <= k < n - 1
+// contribute and the loop needs no wrap-around.
+std::pair<double, double> centroidOf(const double* x, const double* y, size_t n) {
+    if (n == 0) return {0.0, 0.0};
+    double x0 = x[0], y0 = y[0];
+    double doubledArea = 0, cx = 0, cy = 0;
+    for (size_t k = 1; k + 1 < n; ++k) {
+        double ax = x[k] - x0, ay = y[k] - y0;
+        double bx = x[k + 1] - x0, by = y[k + 1] - y0;
+        double cross = ax * by - bx * ay;
+        doubledArea += cross;
+        cx += (ax + bx) * cross;
+        cy += (ay + by) * cross;
+    }
+
+    if (doubledArea == 0) {
+        double meanX = 0, meanY = 0;
+        for (size_t k = 0; k < n; ++k) {
+            meanX += x[k];
+            meanY += y[k];
+        }
+        return {meanX / n, meanY / n};
+    }
+    return {x0 + cx / (3.0 * doubledArea), y0 + cy / (3.0 * doubledArea)};
+}
+
+// Areas of polygons [begin, end), written to out[0, end - begin).
+void areasOf(const double* x, const double* y, const size_t* offsets, size_t begin, size_t end,
+             double* out) {
+    for (size_t i = begin; i < end; ++i) {
+        size_t first = offsets[i];
+        out[i - begin] = std::abs(doubledSignedArea(x + first, y + first, offsets[i + 1] - first)) / 2.0;
+    }
+}
+
+}
+
+PolygonCollection::PolygonCollection() : offsets(1, 0) {}
+
+void PolygonCollection::add(const std::pair<double, double>* vertices, size_t count) {
+    FIGURES_METRIC(Insert);
+    if (count < 3) {
+        throw std::invalid_argument("Polygon needs at least 3 vertices");
+    }
+    for (size_t k = 0; k < count; ++k) {
+        xs.push_back(vertices[k].first);
+        ys.push_back(vertices[k].second);
+    }
+    offsets.push_back(xs.size());
+}
+
+void PolygonCollection::remove(size_t index) {
+    FIGURES_METRIC(Remove);
+    if (index >= size()) return;
+    size_t begin = offsets[index], end = offsets[index + 1], count = end - begin;
+    xs.erase(xs.begin() + begin, xs.begin() + end);
+    ys.erase(ys.begin() + begin, ys.begin() + end);
+    offsets.erase(offsets.begin() + index + 1);
+    for (size_t i = index + 1; i < offsets.size(); ++i) {
+        offsets[i] -= count;
+    }
+}
+
+void PolygonCollection::reserve(size_t polygons, size_t vertices) {
+    offsets.reserve(polygons + 1);
+    xs.reserve(vertices);
+    ys.reserve(vertices);
+}
+
+void PolygonCollection::clear() {
+    xs.clear();
+    ys.clear();
+    offsets.assign(1, 0);
+}
+
+std::pair<double, double> PolygonCollection::vertex(size_t index, size_t k) const {
+    size_t at = offsets[index] + k;
+    return {xs[at], ys[at]};
+}
+
+double PolygonCollection::area(size_t index) const {
+    FIGURES_METRIC(Area);
+    size_t begin = offsets[index];
+    return std::abs(doubledSignedArea(xs.data() + begin, ys.data() + begin, vertexCount(index))) / 2.0;
+}
+
+std::pair<double, double> PolygonCollection::geometricCenter(size_t index) const {
+    FIGURES_METRIC(GeometricCenter);
+    size_t begin = offsets[index];
+    return centroidOf(xs.data() + begin, ys.data() + begin, vertexCount(index));
+}
+
+void PolygonCollection::areas(double* out) const {
+    areasOf(xs.data(), ys.data(), offsets.data(), 0, size(), out);
+}
+
+void PolygonCollection::centroids(std::pair<double, double>* out) const {
+    const double* x = xs.data();
+    const double* y = ys.data();
+    for (size_t i = 0; i < size(); ++i) {
+        size_t begin = offsets[i];
+        out[i] = centroidOf(x + begin, y + begin, offsets[i + 1] - begin);
+    }
+}
+
+double PolygonCollection::totalArea() const {
+    FIGURES_METRIC(TotalArea);
+    // Runs the areas() kernel block by block into a stack buffer, so the
+    // total needs no allocation.
+    const size_t kBlock = 256;
+    double block[kBlock];
+    double total = 0;
+    for (size_t begin = 0; begin < size(); begin += kBlock) {
+        size_t end = std::min(size(), begin + kBlock);
+        areasOf(xs.data(), ys.data(), offsets.data(), begin, end, block);
+        for (size_t i = 0; i < end - begin; ++i) {
+            total += block[i];
+        }
+    }
+    return total;
+}
+
+void PolygonCollection::printVertices(std::ostream& os, size_t index) const {
+    FIGURES_METRIC(Print);
+    os << "Polygon vertices: ";
+    for (size_t k = offsets[index]; k < offsets[index + 1]; ++k) {
+        os << "(" << xs[k] << ", " << ys[k] << ") ";
+    }
+}
+
+void PolygonCollection::readPolygon(std::istream& is) {
+    FIGURES_METRIC(Parse);
+    // Signed, so "-1" fails the range check instead of wrapping around.
+    long long n;
+    if (!(is >> n)) return;
+    if (n < 3 || n > static_cast<long long>(kMaxVertices)) {
+        is.setstate(std::ios::failbit);
+        return;
+    }
+    // Grown as pairs arrive, so a large count on a short stream costs nothing.
+    std::vector<std::pair<double, double>> vertices;
+    for (long long k = 0; k < n; ++k) {
+        double x, y;
+        if (!(is >> x >> y)) return;
+        vertices.push_back({x, y});
+    }
+    add(vertices);
+}
+
+double calculateTotalArea(const std::vector<Figure*>& figures, const PolygonCollection& polygons) {
+    return calculateTotalArea(figures) + polygons.totalArea();
+}
+
+void printAllFiguresInfo(const std::vector<Figure*>& figures, const PolygonCollection& polygons) {
+    printAllFiguresInfo(figures);
+    for (size_t i = 0; i < polygons.size(); ++i) {
+        std::cout << "Figure " << figures.size() + i + 1 << ":\n";
+        std::cout << "  ";
+        polygons.printVertices(std::cout, i);
+        std::cout << "\n";
+        auto center = polygons.geometricCenter(i);
+        std::cout << "  Geometric center: (" << center.first << ", " << center.second << ")\n";
+        std::cout << "  Area: " << polygons.area(i) << "\n\n";
+    }
+}
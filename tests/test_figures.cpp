@@ -1,13 +1,128 @@
 #include <gtest/gtest.h>
 #include "../include/figures.hpp"
+#include "../include/compact_figures.hpp"
+#include "../include/polygons.hpp"
+#include "../include/concurrent_figures.hpp"
+#include "../include/metrics.hpp"
+#ifdef FIGURES_WITH_SERVER
+#include "../include/figure_server.hpp"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#endif
 #include <sstream>
 #include <cmath>
 #include <vector>
 #include <memory>
 #include <array>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 
+// Test-wide allocation counters, fed by the replaceable global operator new.
+// Counting is per thread so background threads do not leak into a measurement.
+thread_local size_t allocationCount = 0;
+thread_local size_t allocatedBytes = 0;
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    allocatedBytes += size;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+// Over-aligned types (e.g. the cache-line reader slots) use these overloads.
+void* operator new(size_t size, align_val_t alignment) {
+    ++allocationCount;
+    allocatedBytes += size;
+    size_t align = static_cast<size_t>(alignment);
+    size_t rounded = (size + align - 1) / align * align;
+    if (void* p = aligned_alloc(align, rounded ? rounded : align)) return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+// GCC flags free() on memory from operator new once both are inlined, even
+// though this replacement pairs them correctly.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t, align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t, align_val_t) noexcept {
+    free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// The first metric recorded on a thread creates its thread_local counters, and
+// some C++ runtimes allocate to register their destructor. Recording once on
+// the main thread up front keeps allocation counts independent of test order.
+class MetricsWarmup : public testing::Environment {
+public:
+    void SetUp() override {
+        recordMetric(Metric::Area, 0);
+        resetMetrics();
+    }
+};
+
+struct AllocationScope {
+    size_t startCount = allocationCount;
+    size_t startBytes = allocatedBytes;
+
+    size_t allocations() const { return allocationCount - startCount; }
+    size_t bytes() const { return allocatedBytes - startBytes; }
+};
+
 unique_ptr<Triangle> createTestTriangle() {
     return make_unique<Triangle>(array<pair<double, double>, 3>{
         make_pair(0, 0), make_pair(3, 0), make_pair(0, 4)
@@ -398,8 +513,823 @@ TEST(ArrayFunctionsTest, PrintAllFiguresInfo) {
     }
 }
 
+TEST(ValidationTest, ClassifyQuadrilateral) {
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {2, 0}, {2, 2}, {0, 2}}}), QuadrilateralKind::Square);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {4, 0}, {4, 2}, {0, 2}}}), QuadrilateralKind::Rectangle);
+    EXPECT_EQ(classifyQuadrilateral({{{1, 0}, {2, 1}, {1, 2}, {0, 1}}}), QuadrilateralKind::Square);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {4, 0}, {5, 2}, {1, 2}}}), QuadrilateralKind::General);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {1, 1}, {1, 0}, {0, 1}}}), QuadrilateralKind::SelfIntersecting);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {1, 0}, {2, 0}, {0, 1}}}), QuadrilateralKind::Degenerate);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}), QuadrilateralKind::Degenerate);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {0.0001, 0}, {0.0001, 0.0001}, {0, 0.0001}}}),
+              QuadrilateralKind::Square);
+    EXPECT_EQ(classifyQuadrilateral({{{0, 0}, {2, 0}, {2, 2.001}, {0, 2}}}, 1e-2),
+              QuadrilateralKind::Square);
+}
+
+TEST(ValidationTest, ValidateFiguresReportsOffendingIndices) {
+    vector<Figure*> figures;
+    figures.push_back(new Triangle(array<pair<double, double>, 3>{{{0, 0}, {3, 0}, {0, 4}}}));
+    figures.push_back(new Square(array<pair<double, double>, 4>{{{0, 0}, {2, 0}, {2, 2}, {0, 2}}}));
+    figures.push_back(new Square(array<pair<double, double>, 4>{{{0, 0}, {4, 0}, {4, 2}, {0, 2}}}));
+    figures.push_back(new Rectangle(array<pair<double, double>, 4>{{{0, 0}, {2, 0}, {2, 2}, {0, 2}}}));
+    figures.push_back(new Rectangle(array<pair<double, double>, 4>{{{0, 0}, {1, 1}, {1, 0}, {0, 1}}}));
+
+    ValidationReport report = validateFigures(figures);
+    ASSERT_EQ(report.invalidIndices.size(), 2);
+    EXPECT_EQ(report.invalidIndices[0], 2);
+    EXPECT_EQ(report.invalidKinds[0], QuadrilateralKind::Rectangle);
+    EXPECT_EQ(report.invalidIndices[1], 4);
+    EXPECT_EQ(report.invalidKinds[1], QuadrilateralKind::SelfIntersecting);
+
+    for (auto fig : figures) {
+        delete fig;
+    }
+}
+
+TEST(ValidationTest, RejectInvalidOnRead) {
+    setRejectInvalidOnRead(true);
+
+    Square square;
+    istringstream bad("0 0 4 0 4 2 0 2");
+    bad >> square;
+    EXPECT_TRUE(bad.fail());
+    EXPECT_TRUE(square == Square());
+
+    Rectangle rect;
+    istringstream good("0 0 4 0 4 2 0 2");
+    good >> rect;
+    EXPECT_FALSE(good.fail());
+    EXPECT_NEAR(static_cast<double>(rect), 8.0, 1e-6);
+
+    setRejectInvalidOnRead(false);
+
+    istringstream lenient("0 0 4 0 4 2 0 2");
+    lenient >> square;
+    EXPECT_FALSE(lenient.fail());
+}
+
+TEST(ValidationTest, StrictReadAcceptsPrintedRotatedFigures) {
+    setRejectInvalidOnRead(true);
+
+    Square square;
+    istringstream printed("0 0 1.75517 0.958851 0.796314 2.71402 -0.958851 1.75517");
+    printed >> square;
+    EXPECT_FALSE(printed.fail());
+
+    const double angle = 0.5;
+    const double c = cos(angle), s = sin(angle);
+    std::array<std::pair<double, double>, 4> corners = {{{0, 0}, {3, 0}, {3, 1.25}, {0, 1.25}}};
+    ostringstream os;
+    for (const auto& corner : corners) {
+        os << 2 + corner.first * c - corner.second * s << ' '
+           << -1 + corner.first * s + corner.second * c << ' ';
+    }
+    Rectangle rect;
+    istringstream rotated(os.str());
+    rotated >> rect;
+    EXPECT_FALSE(rotated.fail());
+    EXPECT_NEAR(static_cast<double>(rect), 3.75, 1e-4);
+
+    setRejectInvalidOnRead(true, kDefaultShapeTolerance);
+    Square exact;
+    istringstream again("0 0 1.75517 0.958851 0.796314 2.71402 -0.958851 1.75517");
+    again >> exact;
+    EXPECT_TRUE(again.fail());
+
+    setRejectInvalidOnRead(false);
+}
+
+TEST(ValidationTest, ClassifyQuadrilateralsVertexMajor) {
+    // More quads than one kernel block, mixing every kind.
+    const size_t count = 150;
+    std::array<std::array<std::pair<double, double>, 4>, 4> shapes = {{
+        {{{0, 0}, {2, 0}, {2, 2}, {0, 2}}},
+        {{{0, 0}, {4, 0}, {4, 2}, {0, 2}}},
+        {{{0, 0}, {4, 4}, {4, 0}, {0, 4}}},
+        {{{0, 0}, {1, 0}, {2, 0}, {3, 0}}},
+    }};
+    std::vector<double> xs(4 * count), ys(4 * count);
+    for (size_t q = 0; q < count; ++q) {
+        for (size_t k = 0; k < 4; ++k) {
+            xs[k * count + q] = shapes[q % 4][k].first + q;
+            ys[k * count + q] = shapes[q % 4][k].second;
+        }
+    }
+    std::vector<QuadrilateralKind> kinds(count);
+    classifyQuadrilaterals(xs.data(), ys.data(), count, kinds.data());
+    for (size_t q = 0; q < count; ++q) {
+        EXPECT_EQ(kinds[q], classifyQuadrilateral(shapes[q % 4])) << "quad " << q;
+    }
+}
+
+TEST(DeduplicationTest, HashIgnoresStartVertexAndDirection) {
+    Square square(array<pair<double, double>, 4>{{{0, 0}, {2, 0}, {2, 2}, {0, 2}}});
+    Square rotated(array<pair<double, double>, 4>{{{2, 2}, {0, 2}, {0, 0}, {2, 0}}});
+    Square reversed(array<pair<double, double>, 4>{{{0, 0}, {0, 2}, {2, 2}, {2, 0}}});
+    Rectangle sameAsRect(array<pair<double, double>, 4>{{{0, 0}, {2, 0}, {2, 2}, {0, 2}}});
+    Square shifted(array<pair<double, double>, 4>{{{0, 0}, {2, 0}, {2, 2.0000001}, {0, 2}}});
+
+    EXPECT_EQ(figureHash(square), figureHash(rotated));
+    EXPECT_EQ(figureHash(square), figureHash(reversed));
+    EXPECT_TRUE(sameFigure(square, rotated));
+    EXPECT_TRUE(sameFigure(square, reversed));
+    EXPECT_FALSE(sameFigure(square, sameAsRect));
+    EXPECT_FALSE(sameFigure(square, shifted));
+    EXPECT_TRUE(sameFigure(square, shifted, 1e-3));
+    EXPECT_EQ(figureHash(square, 1e-3), figureHash(shifted, 1e-3));
+}
+
+TEST(DeduplicationTest, FindAndRemoveDuplicates) {
+    vector<Figure*> figures;
+    for (int i = 0; i < 5000; ++i) {
+        double offset = i % 10;
+        figures.push_back(new Triangle(array<pair<double, double>, 3>{{{offset, 0}, {offset + 3, 0}, {offset, 4}}}));
+        figures.push_back(new Rectangle(array<pair<double, double>, 4>{{{offset, 0}, {offset, 2}, {offset + 4, 2}, {offset + 4, 0}}}));
+    }
+
+    vector<size_t> serial = findDuplicateFigures(figures, 0.0, 1);
+    vector<size_t> parallel = findDuplicateFigures(figures, 0.0, 8);
+    EXPECT_EQ(serial.size(), 10000 - 20);
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial.front(), 20);
+
+    EXPECT_EQ(removeDuplicateFigures(figures, 0.0, 4), 10000 - 20);
+    EXPECT_EQ(figures.size(), 20);
+    EXPECT_TRUE(findDuplicateFigures(figures).empty());
+
+    for (auto fig : figures) {
+        delete fig;
+    }
+}
+
+// A Figure subclass the deduplication code does not know about.
+class UnitDisk : public Figure {
+public:
+    pair<double, double> geometricCenter() const override { return {0, 0}; }
+    double area() const override { return acos(-1.0); }
+    void printVertices(ostream& os) const override { os << "Unit disk"; }
+    void readVertices(istream&) override {}
+    bool operator==(const Figure& other) const override { return this == &other; }
+    Figure& operator=(const Figure&) override { return *this; }
+    unique_ptr<Figure> clone() const override { return make_unique<UnitDisk>(); }
+};
+
+TEST(DeduplicationTest, UnknownFigureTypesAreNeverDuplicates) {
+    UnitDisk first, second;
+    EXPECT_TRUE(sameFigure(first, first));
+    EXPECT_FALSE(sameFigure(first, second));
+
+    vector<Figure*> figures = {new UnitDisk(), new UnitDisk(), createTestTriangle().release(),
+                              createTestTriangle().release()};
+    vector<size_t> duplicates = findDuplicateFigures(figures, 0.0, 2);
+    ASSERT_EQ(duplicates.size(), 1);
+    EXPECT_EQ(duplicates[0], 3);
+
+    for (auto fig : figures) {
+        delete fig;
+    }
+}
+
+vector<Figure*> createRandomFigures(size_t count, double extent, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_real_distribution<double> coord(-extent, extent);
+    uniform_real_distribution<double> side(0.01 * extent, 0.1 * extent);
+    vector<Figure*> figures;
+    for (size_t i = 0; i < count; ++i) {
+        double x = coord(rng), y = coord(rng), w = side(rng), h = side(rng);
+        switch (i % 3) {
+            case 0:
+                figures.push_back(new Triangle(array<pair<double, double>, 3>{{{x, y}, {x + w, y}, {x, y + h}}}));
+                break;
+            case 1:
+                figures.push_back(new Square(array<pair<double, double>, 4>{{{x, y}, {x + w, y}, {x + w, y + w}, {x, y + w}}}));
+                break;
+            default:
+                figures.push_back(new Rectangle(array<pair<double, double>, 4>{{{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}}}));
+        }
+    }
+    return figures;
+}
+
+double perimeterOf(const CompactFigureStore& store, size_t index) {
+    double perimeter = 0;
+    size_t n = store.vertexCount(index);
+    for (size_t k = 0; k < n; ++k) {
+        auto a = store.vertex(index, k);
+        auto b = store.vertex(index, (k + 1) % n);
+        perimeter += hypot(b.first - a.first, b.second - a.second);
+    }
+    return perimeter;
+}
+
+void expectWithinErrorBounds(const vector<Figure*>& figures, const CompactFigureStore& store, double extent) {
+    ASSERT_EQ(store.size(), figures.size());
+    double e = store.coordinateErrorBound(extent * 1.2);
+    for (size_t i = 0; i < figures.size(); ++i) {
+        auto exact = figures[i]->geometricCenter();
+        auto compact = store.geometricCenter(i);
+        EXPECT_LE(abs(compact.first - exact.first), e * 1.01);
+        EXPECT_LE(abs(compact.second - exact.second), e * 1.01);
+        EXPECT_LE(abs(store.area(i) - figures[i]->area()), sqrt(2.0) * e * perimeterOf(store, i) * 1.01 + e * e * 16);
+    }
+}
+
+TEST(CompactStorageTest, Float32WithinErrorBound) {
+    auto figures = createRandomFigures(3000, 1000.0, 1);
+    CompactFigureStore store(VertexStorage::Float32);
+    for (auto fig : figures) store.add(*fig);
+
+    expectWithinErrorBounds(figures, store, 1000.0);
+    EXPECT_TRUE(*store.figure(0) == *store.figure(0)->clone());
+    EXPECT_EQ(store.type(1), FigureType::Square);
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(CompactStorageTest, Fixed32WithinErrorBound) {
+    auto figures = createRandomFigures(3000, 1000.0, 2);
+    CompactFigureStore store = CompactFigureStore::fitFixed32(figures);
+    for (auto fig : figures) store.add(*fig);
+
+    expectWithinErrorBounds(figures, store, 1000.0);
+    EXPECT_NEAR(store.totalArea(), calculateTotalArea(figures), 1e-6 * calculateTotalArea(figures));
+
+    CompactFigureStore narrow(VertexStorage::Fixed32, {0.0, 0.0}, 1e-9);
+    EXPECT_THROW(narrow.add(*figures[0]), out_of_range);
+    EXPECT_EQ(narrow.size(), 0);
+
+    CompactFigureStore floats(VertexStorage::Float32);
+    Square huge(array<pair<double, double>, 4>{{{0, 0}, {1e39, 0}, {1e39, 1e39}, {0, 1e39}}});
+    EXPECT_THROW(floats.add(huge), out_of_range);
+    Triangle notANumber(array<pair<double, double>, 3>{{{0, 0}, {nan(""), 0}, {0, 1}}});
+    EXPECT_THROW(floats.add(notANumber), out_of_range);
+    EXPECT_EQ(floats.size(), 0);
+    EXPECT_EQ(floats.memoryBytes(), 0);
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(CompactStorageTest, ExactForGridAlignedFigures) {
+    CompactFigureStore store(VertexStorage::Fixed32, {0.0, 0.0}, 0.5);
+    store.reserve(3);
+    store.add(*createTestTriangle());
+    store.add(*createTestSquare());
+    store.add(*createTestRectangle());
+
+    EXPECT_DOUBLE_EQ(store.area(0), 6.0);
+    EXPECT_DOUBLE_EQ(store.area(1), 4.0);
+    EXPECT_DOUBLE_EQ(store.area(2), 8.0);
+    EXPECT_DOUBLE_EQ(store.totalArea(), 18.0);
+    EXPECT_TRUE(*store.figure(2) == *createTestRectangle());
+    EXPECT_LT(store.memoryBytes() / store.size(), sizeof(Rectangle));
+}
+
+TEST(PolygonTest, MatchesRectangleReference) {
+    auto figures = createRandomFigures(300, 100.0, 3);
+    PolygonCollection polygons;
+    for (auto fig : figures) {
+        if (auto rect = dynamic_cast<Rectangle*>(fig)) {
+            polygons.add(rect->getVertices());
+        } else if (auto tri = dynamic_cast<Triangle*>(fig)) {
+            polygons.add(tri->getVertices());
+        }
+    }
+    ASSERT_EQ(polygons.size(), 200);
+
+    vector<double> areas(polygons.size());
+    polygons.areas(areas.data());
+    vector<pair<double, double>> centroids(polygons.size());
+    polygons.centroids(centroids.data());
+    size_t p = 0;
+    for (auto fig : figures) {
+        if (dynamic_cast<Square*>(fig)) continue;
+        EXPECT_NEAR(areas[p], fig->area(), 1e-12 * fig->area());
+        EXPECT_EQ(polygons.area(p), areas[p]);
+        auto center = polygons.geometricCenter(p);
+        EXPECT_EQ(centroids[p], center);
+        EXPECT_NEAR(center.first, fig->geometricCenter().first, 1e-9);
+        EXPECT_NEAR(center.second, fig->geometricCenter().second, 1e-9);
+        ++p;
+    }
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(PolygonTest, HexagonAndConcavePolygon) {
+    PolygonCollection polygons;
+    vector<pair<double, double>> hexagon;
+    for (int k = 0; k < 6; ++k) {
+        hexagon.push_back({5 + 2 * cos(k * acos(-1.0) / 3), 7 + 2 * sin(k * acos(-1.0) / 3)});
+    }
+    polygons.add(hexagon);
+    polygons.add(vector<pair<double, double>>{{0, 0}, {4, 0}, {4, 4}, {2, 1}, {0, 4}});
+
+    EXPECT_NEAR(polygons.area(0), 3 * sqrt(3.0) / 2 * 4, 1e-9);
+    EXPECT_NEAR(polygons.geometricCenter(0).first, 5.0, 1e-9);
+    EXPECT_NEAR(polygons.geometricCenter(0).second, 7.0, 1e-9);
+    EXPECT_NEAR(polygons.area(1), 10.0, 1e-9);
+    EXPECT_EQ(polygons.vertexCount(1), 5);
+    // Concave "M": centroid of the 16-unit square minus the notch triangle.
+    EXPECT_NEAR(polygons.geometricCenter(1).first, 2.0, 1e-9);
+    EXPECT_NEAR(polygons.geometricCenter(1).second, (16 * 2.0 - 6 * 3.0) / 10, 1e-9);
+
+    polygons.remove(0);
+    EXPECT_EQ(polygons.size(), 1);
+    EXPECT_EQ(polygons.totalVertices(), 5);
+    EXPECT_NEAR(polygons.totalArea(), 10.0, 1e-9);
+}
+
+TEST(PolygonTest, ReadTotalAreaAndReport) {
+    PolygonCollection polygons;
+    istringstream iss("5 0 0 2 0 3 1 2 2 0 2");
+    polygons.readPolygon(iss);
+    ASSERT_EQ(polygons.size(), 1);
+    EXPECT_NEAR(polygons.area(0), 5.0, 1e-9);
+
+    istringstream bad("2 0 0 1 1");
+    polygons.readPolygon(bad);
+    EXPECT_TRUE(bad.fail());
+    EXPECT_EQ(polygons.size(), 1);
+
+    for (const char* input : {"-1 0 0 1 0 1 1", "4000000000000 0 0 1 0 1 1", "4 0 0 1 0 1 1"}) {
+        istringstream rejected(input);
+        polygons.readPolygon(rejected);
+        EXPECT_TRUE(rejected.fail()) << input;
+        EXPECT_EQ(polygons.size(), 1) << input;
+        EXPECT_EQ(polygons.totalVertices(), 5) << input;
+    }
+
+    EXPECT_THROW(polygons.add(vector<pair<double, double>>{{0, 0}, {1, 1}}), invalid_argument);
+    EXPECT_EQ(polygons.size(), 1);
+
+    vector<Figure*> figures;
+    figures.push_back(new Square(array<pair<double, double>, 4>{{{0, 0}, {1, 0}, {1, 1}, {0, 1}}}));
+    EXPECT_NEAR(calculateTotalArea(figures, polygons), 6.0, 1e-9);
+
+    streambuf* old_cout = cout.rdbuf();
+    ostringstream test_output;
+    cout.rdbuf(test_output.rdbuf());
+    printAllFiguresInfo(figures, polygons);
+    cout.rdbuf(old_cout);
+
+    string output = test_output.str();
+    EXPECT_NE(output.find("Figure 2"), string::npos);
+    EXPECT_NE(output.find("Polygon vertices"), string::npos);
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(ConcurrentCollectionTest, InsertRemoveAndSnapshot) {
+    ConcurrentFigureCollection collection;
+    uint64_t tri = collection.insert(createTestTriangle());
+    uint64_t square = collection.insert(createTestSquare());
+    collection.insert(createTestRectangle());
+
+    EXPECT_EQ(collection.size(), 3);
+    EXPECT_NEAR(collection.totalArea(), 18.0, 1e-9);
+
+    EXPECT_TRUE(collection.remove(square));
+    EXPECT_FALSE(collection.remove(square));
+    EXPECT_NEAR(collection.totalArea(), 14.0, 1e-9);
+
+    vector<uint64_t> ids;
+    collection.read([&ids](const FigureSnapshot& snapshot) {
+        snapshot.forEach([&ids](uint64_t id, const Figure&) { ids.push_back(id); });
+    });
+    EXPECT_EQ(ids.size(), 2);
+    EXPECT_EQ(ids.front(), tri);
+}
+
+TEST(ConcurrentCollectionTest, FifoChurnKeepsChunkCountBounded) {
+    ConcurrentFigureCollection collection;
+    const size_t live = 1000;
+    std::deque<uint64_t> ids;
+    for (size_t i = 0; i < live; ++i) {
+        ids.push_back(collection.insert(createTestSquare()));
+    }
+
+    size_t maxChunks = live / ConcurrentFigureCollection::kChunkSize + 2;
+    for (size_t round = 0; round < 10 * live; ++round) {
+        ids.push_back(collection.insert(createTestSquare()));
+        ASSERT_TRUE(collection.remove(ids.front()));
+        ids.pop_front();
+        size_t chunks = collection.read([](const FigureSnapshot& snapshot) { return snapshot.chunkCount(); });
+        ASSERT_LE(chunks, maxChunks) << "round " << round;
+    }
+
+    EXPECT_EQ(collection.size(), live);
+    EXPECT_NEAR(collection.totalArea(), 4.0 * live, 1e-6);
+    // Ids in chunks after a dropped one must still be removable.
+    while (!ids.empty()) {
+        ASSERT_TRUE(collection.remove(ids.back()));
+        ids.pop_back();
+    }
+    EXPECT_EQ(collection.read([](const FigureSnapshot& snapshot) { return snapshot.chunkCount(); }), 0);
+}
+
+TEST(ConcurrentCollectionTest, SparseRemovalKeepsChunkCountBounded) {
+    const size_t chunkSize = ConcurrentFigureCollection::kChunkSize;
+    auto chunkCount = [](const ConcurrentFigureCollection& collection) {
+        return collection.read([](const FigureSnapshot& snapshot) { return snapshot.chunkCount(); });
+    };
+    auto liveIds = [](const ConcurrentFigureCollection& collection) {
+        vector<uint64_t> ids;
+        collection.read([&ids](const FigureSnapshot& snapshot) {
+            snapshot.forEach([&ids](uint64_t id, const Figure&) { ids.push_back(id); });
+        });
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    // Keep only every 256th figure.
+    ConcurrentFigureCollection sparse;
+    vector<uint64_t> ids, kept;
+    for (size_t i = 0; i < 32 * chunkSize; ++i) ids.push_back(sparse.insert(createTestSquare()));
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % chunkSize == 0) kept.push_back(ids[i]);
+        else ASSERT_TRUE(sparse.remove(ids[i]));
+    }
+    EXPECT_EQ(sparse.size(), 32);
+    EXPECT_EQ(chunkCount(sparse), 1);
+    EXPECT_EQ(liveIds(sparse), kept);
+
+    // Random removal interleaved with inserts.
+    ConcurrentFigureCollection churned;
+    vector<uint64_t> live;
+    mt19937 rng(11);
+    for (size_t i = 0; i < 8 * chunkSize; ++i) live.push_back(churned.insert(createTestSquare()));
+    for (size_t round = 0; round < 12 * chunkSize; ++round) {
+        size_t victim = uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+        swap(live[victim], live.back());
+        ASSERT_TRUE(churned.remove(live.back()));
+        live.pop_back();
+        if (round % 3 == 0) live.push_back(churned.insert(createTestSquare()));
+        ASSERT_LE(chunkCount(churned), 8 * live.size() / chunkSize + 2) << "round " << round;
+    }
+    sort(live.begin(), live.end());
+    EXPECT_EQ(liveIds(churned), live);
+    EXPECT_NEAR(churned.totalArea(), 4.0 * live.size(), 1e-6);
+    for (uint64_t id : live) ASSERT_TRUE(churned.remove(id));
+    EXPECT_EQ(chunkCount(churned), 0);
+}
+
+TEST(ConcurrentCollectionTest, ReadersSeeConsistentSnapshots) {
+    ConcurrentFigureCollection collection;
+    atomic<bool> done{false};
+    atomic<long> inconsistent{0};
+    atomic<long> reads{0};
+
+    vector<thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&]() {
+            while (!done.load()) {
+                collection.read([&](const FigureSnapshot& snapshot) {
+                    size_t count = 0;
+                    double area = 0;
+                    snapshot.forEach([&](uint64_t, const Figure& figure) {
+                        ++count;
+                        area += figure.area();
+                    });
+                    if (count != snapshot.size() || abs(area - snapshot.totalArea()) > 1e-6 * (area + 1)) {
+                        ++inconsistent;
+                    }
+                });
+                ++reads;
+                this_thread::yield();
+            }
+        });
+    }
+
+    vector<thread> writers;
+    for (int w = 0; w < 4; ++w) {
+        writers.emplace_back([&collection]() {
+            vector<uint64_t> mine;
+            for (int i = 0; i < 300; ++i) {
+                mine.push_back(collection.insert(createTestRectangle()));
+                if (i % 3 == 0) {
+                    collection.remove(mine[mine.size() / 2]);
+                    mine.erase(mine.begin() + mine.size() / 2);
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    done = true;
+    for (auto& reader : readers) reader.join();
+
+    EXPECT_EQ(inconsistent.load(), 0);
+    EXPECT_GT(reads.load(), 0);
+    EXPECT_EQ(collection.size(), 4 * 200);
+    EXPECT_NEAR(collection.totalArea(), 4 * 200 * 8.0, 1e-6);
+}
+
+TEST(MetricsTest, RecordCollectAndDump) {
+    resetMetrics();
+    recordMetric(Metric::Parse, 100);
+    recordMetric(Metric::Parse, 300);
+    thread([]() { recordMetric(Metric::Parse, 5000); }).join();
+
+    auto summaries = collectMetrics();
+    const MetricSummary& parse = summaries[static_cast<size_t>(Metric::Parse)];
+    EXPECT_EQ(parse.count, 3);
+    EXPECT_EQ(parse.totalNs, 5400);
+    EXPECT_EQ(parse.maxNs, 5000);
+    EXPECT_EQ(parse.buckets[6], 1);
+    EXPECT_EQ(parse.quantileNs(0.5), 511);
+
+    ostringstream json;
+    dumpMetricsJson(json);
+    EXPECT_NE(json.str().find("\"parse\": {\"count\": 3"), string::npos);
+
+    ostringstream text;
+    dumpMetricsText(text);
+    EXPECT_NE(text.str().find("parse: count=3"), string::npos);
+
+    resetMetrics();
+    EXPECT_EQ(collectMetrics()[static_cast<size_t>(Metric::Parse)].count, 0);
+}
+
+TEST(MetricsTest, HotPathsRecordWhenEnabled) {
+    resetMetrics();
+    auto rect = createTestRectangle();
+    rect->area();
+    rect->geometricCenter();
+
+    auto summaries = collectMetrics();
+    uint64_t expected = kMetricsEnabled ? 1 : 0;
+    EXPECT_EQ(summaries[static_cast<size_t>(Metric::Area)].count, expected);
+    EXPECT_EQ(summaries[static_cast<size_t>(Metric::GeometricCenter)].count, expected);
+}
+
+TEST(AllocationTest, BulkAreaDoesNotAllocate) {
+    auto figures = createRandomFigures(3000, 100.0, 4);
+    CompactFigureStore store(VertexStorage::Float32);
+    PolygonCollection polygons;
+    for (auto fig : figures) {
+        store.add(*fig);
+        if (auto rect = dynamic_cast<Rectangle*>(fig)) polygons.add(rect->getVertices());
+    }
+    vector<double> areas(polygons.size());
+
+    AllocationScope scope;
+    double total = calculateTotalArea(figures);
+    total += store.totalArea();
+    polygons.areas(areas.data());
+    total += polygons.totalArea();
+    for (auto fig : figures) {
+        total += fig->geometricCenter().first;
+    }
+    EXPECT_EQ(scope.allocations(), 0);
+    EXPECT_GT(total, 0);
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(AllocationTest, CloneAndRemoveAllocationCounts) {
+    auto rect = createTestRectangle();
+    vector<Figure*> figures;
+    figures.reserve(3);
+    for (int i = 0; i < 3; ++i) figures.push_back(new Rectangle(*rect));
+
+    AllocationScope cloneScope;
+    auto copy = rect->clone();
+    EXPECT_EQ(cloneScope.allocations(), 1);
+
+    AllocationScope removeScope;
+    removeFigureByIndex(figures, 1);
+    removeFigureByIndex(figures, 0);
+    EXPECT_EQ(removeScope.allocations(), 0);
+
+    for (auto fig : figures) delete fig;
+}
+
+TEST(AllocationTest, CountsOverAlignedAllocations) {
+    static_assert(alignof(ConcurrentFigureCollection) > __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                  "reader slots are cache-line aligned");
+    AllocationScope scope;
+    auto collection = make_unique<ConcurrentFigureCollection>();
+    // The collection itself plus its initial empty snapshot.
+    EXPECT_EQ(scope.allocations(), 2);
+    EXPECT_GE(scope.bytes(), sizeof(ConcurrentFigureCollection));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(collection.get()) % alignof(ConcurrentFigureCollection), 0);
+}
+
+TEST(AllocationTest, BytesPerFigureByStorageMode) {
+    const size_t n = 4096;
+    auto source = createRandomFigures(n, 100.0, 5);
+
+    AllocationScope heapScope;
+    vector<Figure*> heap;
+    heap.reserve(n);
+    for (auto fig : source) heap.push_back(fig->clone().release());
+    double heapBytes = double(heapScope.bytes()) / n;
+
+    AllocationScope floatScope;
+    CompactFigureStore floatStore(VertexStorage::Float32);
+    floatStore.reserve(n);
+    for (auto fig : source) floatStore.add(*fig);
+    double floatBytes = double(floatScope.bytes()) / n;
+
+    AllocationScope fixedScope;
+    CompactFigureStore fixedStore(VertexStorage::Fixed32, {0.0, 0.0}, 1.0 / 1024);
+    fixedStore.reserve(n);
+    for (auto fig : source) fixedStore.add(*fig);
+    double fixedBytes = double(fixedScope.bytes()) / n;
+
+    size_t vertices = 0;
+    for (auto fig : source) vertices += dynamic_cast<Triangle*>(fig) ? 3 : 4;
+    AllocationScope csrScope;
+    PolygonCollection polygons;
+    polygons.reserve(n, vertices);
+    AllocationScope csrAddScope;
+    for (auto fig : source) {
+        if (auto tri = dynamic_cast<Triangle*>(fig)) polygons.add(tri->getVertices());
+        else if (auto square = dynamic_cast<Square*>(fig)) polygons.add(square->getVertices());
+        else if (auto rect = dynamic_cast<Rectangle*>(fig)) polygons.add(rect->getVertices());
+    }
+    EXPECT_EQ(csrAddScope.allocations(), 0);
+    double csrBytes = double(csrScope.bytes()) / n;
+
+    RecordProperty("heap_bytes_per_figure", to_string(heapBytes));
+    RecordProperty("float32_bytes_per_figure", to_string(floatBytes));
+    RecordProperty("fixed32_bytes_per_figure", to_string(fixedBytes));
+    RecordProperty("csr_bytes_per_figure", to_string(csrBytes));
+
+    EXPECT_LE(floatBytes, 33.0);
+    EXPECT_LE(fixedBytes, 33.0);
+    EXPECT_LT(floatBytes * 2, heapBytes);
+    EXPECT_LT(csrBytes, heapBytes);
+
+    for (auto fig : heap) delete fig;
+    for (auto fig : source) delete fig;
+}
+
+#ifdef FIGURES_WITH_SERVER
+TEST(ServerTest, PipelinedRequestsAnsweredInOrder) {
+    string path = "/tmp/figures_test_" + to_string(getpid()) + ".sock";
+    FigureServer server(path);
+    thread serverThread([&server]() { server.run(); });
+
+    {
+        FigureClient client(path);
+        client.send("ADD RECTANGLE 0 0 4 0 4 2 0 2");
+        client.send("ADD TRIANGLE 0 0 3 0 0 4");
+        client.send("ADD SQUARE 0 0 2 0");
+        client.send("ADD SQUARE 0 0 2 0 2 2 0 2");
+        client.send("TOTAL");
+        client.send("REMOVE 2");
+        client.send("REMOVE 2");
+        client.send("COUNT");
+        client.send("REPORT");
+        client.send("FROB");
+        client.flush();
+
+        EXPECT_EQ(client.readLine(), "OK 1");
+        EXPECT_EQ(client.readLine(), "OK 2");
+        EXPECT_EQ(client.readLine(), "ERR bad figure");
+        EXPECT_EQ(client.readLine(), "OK 3");
+        EXPECT_NEAR(stod(client.readLine().substr(3)), 18.0, 1e-9);
+        EXPECT_EQ(client.readLine(), "OK");
+        EXPECT_EQ(client.readLine(), "ERR not found");
+        EXPECT_EQ(client.readLine(), "OK 2");
+        EXPECT_EQ(client.readLine().substr(0, 9), "FIGURE 1 ");
+        EXPECT_EQ(client.readLine().substr(0, 9), "FIGURE 3 ");
+        EXPECT_EQ(client.readLine(), "OK 2");
+        EXPECT_EQ(client.readLine(), "ERR unknown command");
+    }
+
+    vector<thread> clients;
+    for (int c = 0; c < 4; ++c) {
+        clients.emplace_back([&path]() {
+            FigureClient client(path);
+            for (int i = 0; i < 100; ++i) client.send("ADD SQUARE 0 0 1 0 1 1 0 1");
+            client.flush();
+            for (int i = 0; i < 100; ++i) client.readLine();
+        });
+    }
+    for (auto& client : clients) client.join();
+
+    EXPECT_EQ(server.collection().size(), 402);
+    EXPECT_NEAR(server.collection().totalArea(), 12.0 + 400.0, 1e-9);
+
+    server.stop();
+    serverThread.join();
+}
+
+TEST(ServerTest, SlowReaderDoesNotStallOthers) {
+    string path = "/tmp/figures_test_" + to_string(getpid()) + ".sock";
+    FigureServer server(path);
+    vector<unique_ptr<Figure>> batch;
+    for (int i = 0; i < 200; ++i) batch.push_back(createTestSquare());
+    server.collection().insert(move(batch));
+    thread serverThread([&server]() { server.run(); });
+
+    // Far more report output than the server buffers for one connection.
+    const int reports = 2000;
+    FigureClient slow(path);
+    for (int i = 0; i < reports; ++i) slow.send("REPORT");
+    slow.flush();
+
+    FigureClient other(path);
+    other.send("COUNT");
+    other.flush();
+    EXPECT_EQ(other.readLine(), "OK 200");
+
+    for (int i = 0; i < reports; ++i) {
+        for (int f = 0; f < 200; ++f) ASSERT_EQ(slow.readLine().substr(0, 7), "FIGURE ");
+        ASSERT_EQ(slow.readLine(), "OK 200");
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+TEST(ServerTest, HalfClosedClientGetsEveryResponse) {
+    string path = "/tmp/figures_test_" + to_string(getpid()) + ".sock";
+    FigureServer server(path);
+    thread serverThread([&server]() { server.run(); });
+
+    // More lines than one round takes from a connection.
+    FigureClient client(path);
+    for (int i = 0; i < 1000; ++i) client.send("ADD SQUARE 0 0 1 0 1 1 0 1");
+    client.finish();
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(client.readLine(), "OK " + to_string(i + 1));
+    }
+    EXPECT_THROW(client.readLine(), runtime_error);
+
+    server.stop();
+    serverThread.join();
+}
+
+TEST(ServerTest, AcceptBacksOffWhileOutOfDescriptors) {
+    string path = "/tmp/figures_test_" + to_string(getpid()) + ".sock";
+    FigureServer server(path);
+    thread serverThread([&server]() { server.run(); });
+    clockid_t serverClock;
+    ASSERT_EQ(pthread_getcpuclockid(serverThread.native_handle(), &serverClock), 0);
+    auto serverCpuMs = [&serverClock]() {
+        timespec now;
+        clock_gettime(serverClock, &now);
+        return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+    };
+
+    // Leave exactly one free descriptor, taken by the client, so the
+    // server's accept() fails with EMFILE while the connection stays queued.
+    rlimit original;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &original), 0);
+    int lowestFree = dup(0);
+    ASSERT_GE(lowestFree, 0);
+    close(lowestFree);
+    rlimit limited = original;
+    limited.rlim_cur = lowestFree + 1;
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limited), 0);
+
+    FigureClient client(path);
+    client.send("COUNT");
+    client.flush();
+    double before = serverCpuMs();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    double spent = serverCpuMs() - before;
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &original), 0);
+
+    EXPECT_LT(spent, 100.0);
+    EXPECT_EQ(client.readLine(), "OK 0");
+
+    server.stop();
+    serverThread.join();
+}
+
+TEST(ServerTest, OnlyReplacesStaleSockets) {
+    string path = "/tmp/figures_test_" + to_string(getpid()) + ".sock";
+    {
+        ofstream file(path);
+        file << "keep me\n";
+    }
+    EXPECT_THROW(FigureServer server(path), runtime_error);
+    EXPECT_EQ(access(path.c_str(), F_OK), 0);
+    unlink(path.c_str());
+
+    {
+        FigureServer live(path);
+        EXPECT_THROW(FigureServer second(path), runtime_error);
+    }
+
+    // A socket file nobody listens on, as left by a crashed server.
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    close(fd);
+    EXPECT_NO_THROW(FigureServer server(path));
+}
+#endif
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
+    testing::AddGlobalTestEnvironment(new MetricsWarmup);
     int result = RUN_ALL_TESTS();
     return result;
 }
\ No newline at end of file